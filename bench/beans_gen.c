@@ -0,0 +1,195 @@
+#define _GNU_SOURCE
+#include "beans_gen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "helper.h"
+
+#define MAX_PARAMS 3
+
+typedef struct {
+  const BeansGenParams *params;
+  FILE *out;
+  uint64_t rng;
+  size_t *nparams; /* of every function */
+  size_t nvars;    /* in scope in the current function */
+} Gen;
+
+void
+beans_gen_default(BeansGenParams *params) {
+  params->fns = 10000;
+  params->stmts = 12;
+  params->depth = 3;
+  params->ident_len = 12;
+  params->literal_pct = 40;
+  params->seed = 1;
+}
+
+/* returns the number after argv[*i] and skips it */
+static uint64_t
+parse_num(int argc, char *argv[], int *i) {
+  if (*i + 1 >= argc) {
+    log_err_final("expected number after %s", argv[*i]);
+  }
+  char *end;
+  uint64_t val = strtoull(argv[*i + 1], &end, 10);
+  if (*end != '\0') {
+    log_err_final("invalid number '%s' for %s", argv[*i + 1], argv[*i]);
+  }
+  (*i)++;
+  return val;
+}
+
+int
+beans_gen_parse_args(BeansGenParams *params, int argc, char *argv[]) {
+  int kept = 1;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-fns") == 0) {
+      params->fns = parse_num(argc, argv, &i);
+    } else if (strcmp(argv[i], "-stmts") == 0) {
+      params->stmts = parse_num(argc, argv, &i);
+    } else if (strcmp(argv[i], "-depth") == 0) {
+      params->depth = parse_num(argc, argv, &i);
+    } else if (strcmp(argv[i], "-ident") == 0) {
+      params->ident_len = parse_num(argc, argv, &i);
+    } else if (strcmp(argv[i], "-literals") == 0) {
+      uint64_t pct = parse_num(argc, argv, &i);
+      params->literal_pct = pct > 100 ? 100 : pct;
+    } else if (strcmp(argv[i], "-seed") == 0) {
+      params->seed = parse_num(argc, argv, &i);
+    } else {
+      argv[kept++] = argv[i];
+    }
+  }
+  return kept;
+}
+
+static uint64_t
+next_rand(Gen *gen) {
+  /* xorshift64*, the state is never 0 */
+  gen->rng ^= gen->rng >> 12;
+  gen->rng ^= gen->rng << 25;
+  gen->rng ^= gen->rng >> 27;
+  return gen->rng * 0x2545f4914f6cdd1dull;
+}
+
+static size_t
+rand_below(Gen *gen, size_t n) {
+  return next_rand(gen) % n;
+}
+
+/* prefix and idx padded to ident_len, so that names of every length stay
+ * unique */
+static void
+put_ident(Gen *gen, char prefix, size_t idx) {
+  int len = fprintf(gen->out, "%c%zu", prefix, idx);
+  for (size_t i = len; i < gen->params->ident_len; i++) {
+    fputc('_', gen->out);
+  }
+}
+
+static void
+put_operand(Gen *gen) {
+  if (gen->nvars == 0 || rand_below(gen, 100) < gen->params->literal_pct) {
+    /* never 0, so that nothing divides by zero */
+    fprintf(gen->out, "%zui32", 1 + rand_below(gen, 999));
+  } else {
+    put_ident(gen, 'v', rand_below(gen, gen->nvars));
+  }
+}
+
+/* The left operand always nests depth - 1 deep, so every expression reaches
+ * depth without growing exponentially */
+static void
+put_expr(Gen *gen, size_t depth) {
+  static const char ops[] = "+-*/";
+  if (depth == 0) {
+    put_operand(gen);
+    return;
+  }
+  put_expr(gen, depth - 1);
+  fprintf(gen->out, " %c ", ops[rand_below(gen, 4)]);
+  size_t right = rand_below(gen, depth);
+  if (right > 0) {
+    fputc('(', gen->out);
+    put_expr(gen, right);
+    fputc(')', gen->out);
+  } else {
+    put_operand(gen);
+  }
+}
+
+static void
+put_call(Gen *gen) {
+  size_t callee = rand_below(gen, gen->params->fns);
+  put_ident(gen, 'f', callee);
+  fputc('(', gen->out);
+  for (size_t i = 0; i < gen->nparams[callee]; i++) {
+    if (i > 0) {
+      fprintf(gen->out, ", ");
+    }
+    put_expr(gen, gen->params->depth / 2);
+  }
+  fputc(')', gen->out);
+}
+
+static void
+put_fn(Gen *gen, size_t fn) {
+  /* parameters are the first variables of the function */
+  put_ident(gen, 'f', fn);
+  fputc('(', gen->out);
+  for (size_t i = 0; i < gen->nparams[fn]; i++) {
+    if (i > 0) {
+      fprintf(gen->out, ", ");
+    }
+    put_ident(gen, 'v', i);
+    fprintf(gen->out, " i32");
+  }
+  fprintf(gen->out, ") i32 {\n");
+  gen->nvars = gen->nparams[fn];
+
+  for (size_t i = 0; i < gen->params->stmts; i++) {
+    size_t kind = rand_below(gen, 100);
+    fputc('\t', gen->out);
+    if (kind < 15) {
+      fprintf(gen->out, "mut ");
+      put_ident(gen, 'v', gen->nvars);
+      fprintf(gen->out, ": i32 = ");
+      put_expr(gen, gen->params->depth);
+    } else {
+      fprintf(gen->out, "let ");
+      put_ident(gen, 'v', gen->nvars);
+      fprintf(gen->out, " = ");
+      if (kind < 30) {
+        put_call(gen);
+      } else {
+        put_expr(gen, gen->params->depth);
+      }
+    }
+    fputc('\n', gen->out);
+    gen->nvars++;
+  }
+
+  fprintf(gen->out, "\treturn ");
+  put_expr(gen, gen->params->depth);
+  fprintf(gen->out, "\n}\n\n");
+}
+
+char *
+beans_gen(const BeansGenParams *params, size_t *sz) {
+  char *buf;
+  Gen gen = {.params = params, .rng = params->seed | 1};
+  gen.out = open_memstream(&buf, sz);
+  gen.nparams = malloc(sizeof(size_t) * params->fns);
+  for (size_t i = 0; i < params->fns; i++) {
+    gen.nparams[i] = rand_below(&gen, MAX_PARAMS + 1);
+  }
+  for (size_t i = 0; i < params->fns; i++) {
+    put_fn(&gen, i);
+  }
+  fclose(gen.out);
+  free(gen.nparams);
+  return buf;
+}
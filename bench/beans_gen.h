@@ -0,0 +1,25 @@
+#ifndef BEANS_GEN_H
+#define BEANS_GEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Shape of a synthetic program.  Every function returns i32, takes up to
+ * three parameters and calls functions anywhere in the program. */
+typedef struct {
+  size_t fns;
+  size_t stmts;         /* per function, not counting the return */
+  size_t depth;         /* of the binary operators in every expression */
+  size_t ident_len;     /* of variable and function names */
+  unsigned literal_pct; /* chance that an operand is a literal */
+  uint64_t seed;
+} BeansGenParams;
+
+void beans_gen_default(BeansGenParams *params);
+/* Reads -fns, -stmts, -depth, -ident, -literals and -seed from argv and
+ * leaves every other argument in place, returns the new argc */
+int beans_gen_parse_args(BeansGenParams *params, int argc, char *argv[]);
+/* Returns a valid Beans program allocated with malloc */
+char *beans_gen(const BeansGenParams *params, size_t *sz);
+
+#endif
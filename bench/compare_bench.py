@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""Compares the results of compile_bench against a stored baseline.
+
+Fails when the throughput of any phase dropped by more than the threshold,
+given in percent.  Baselines only make sense on the machine they were
+recorded on, so the first run on a host records the results as the baseline,
+and runs on another host than the baseline's are skipped.  Both exit with
+77, which meson reports as a skip.
+"""
+
+import argparse
+import json
+import platform
+import sys
+
+METRICS = ("mb_per_s", "tokens_per_s", "fns_per_s")
+SKIP = 77
+
+
+def host_name():
+    """names the machine and its CPU, which the throughput depends on"""
+    cpu = platform.processor() or platform.machine()
+    try:
+        with open("/proc/cpuinfo") as f:
+            for line in f:
+                if line.startswith("model name"):
+                    cpu = line.split(":", 1)[1].strip()
+                    break
+    except OSError:
+        pass
+    return "%s (%s)" % (platform.node(), cpu)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("baseline")
+    parser.add_argument("result")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="allowed slowdown in percent (default 10)")
+    args = parser.parse_args()
+
+    with open(args.result) as f:
+        result = json.load(f)
+    result["host"] = host_name()
+
+    try:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+    except FileNotFoundError:
+        with open(args.baseline, "w") as f:
+            json.dump(result, f, indent=2)
+            f.write("\n")
+        print("recorded a baseline for %s in %s" %
+              (result["host"], args.baseline))
+        return SKIP
+
+    if baseline.get("host") != result["host"]:
+        print("skipped: the baseline was recorded on %s, this is %s" %
+              (baseline.get("host", "an unknown host"), result["host"]))
+        return SKIP
+
+    if baseline["params"] != result["params"]:
+        print("warning: the baseline was recorded with different parameters")
+
+    failed = False
+    print("%-14s %14s %14s %9s" % ("phase", "baseline MB/s", "MB/s", "change"))
+    for phase, base in baseline["phases"].items():
+        now = result["phases"].get(phase)
+        if now is None:
+            print("%-14s missing from the results" % phase)
+            failed = True
+            continue
+        change = (now["mb_per_s"] / base["mb_per_s"] - 1) * 100
+        slower = [m for m in METRICS
+                  if now[m] < base[m] * (1 - args.threshold / 100)]
+        print("%-14s %14.1f %14.1f %+8.1f%%%s" %
+              (phase, base["mb_per_s"], now["mb_per_s"], change,
+               "  REGRESSION" if slower else ""))
+        failed |= bool(slower)
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,183 @@
+/* Compiler throughput benchmark.
+ *
+ * Compiles a synthetic program from beans_gen several times and reports the
+ * best time of every phase as MB/s, tokens/s and functions/s.  With -json the
+ * results are also written to a file that bench/compare_bench.py checks
+ * against a stored baseline. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "beans_gen.h"
+#include "helper.h"
+#include "intern.h"
+#include "ir_gen.h"
+#include "lexer.h"
+#include "parser.h"
+#include "semantics.h"
+#include "ssa.h"
+
+typedef enum {
+  PHASE_LEX,
+  PHASE_PARSE,
+  PHASE_DECLARE,
+  PHASE_CHECK,
+  PHASE_TRANSLATE,
+  PHASE_COUNT,
+} Phase;
+
+static const char *phase_names[] = {"lex",       "parse",
+                                     "declare",   "check_fns",
+                                     "translate_ast"};
+
+typedef struct {
+  Interner interner;
+  AST ast;
+  SSA_Prog prog;
+  const uint8_t *src;
+  size_t sz;
+  size_t tokens;
+  size_t fns;
+  size_t exprs;     /* expression nodes */
+  size_t ast_bytes; /* allocated by the parser */
+} Bench;
+
+/* one compile, best[phase] keeps the shortest time seen so far */
+static void
+run_once(Bench *bench, uint64_t *best) {
+  uint64_t times[PHASE_COUNT + 1];
+  interner_reset(&bench->interner);
+  ast_reset(&bench->ast);
+  ssa_prog_reset(&bench->prog);
+  SourceFile *file = ast_add_file(&bench->ast, "bench.bn", bench->src,
+                                  bench->sz);
+  MemPool *pool = &bench->ast.worker_pools[0];
+
+  times[PHASE_LEX] = wall_time_ns();
+  Lexer lex;
+  lexer_init(&lex, bench->src, bench->sz, &bench->interner);
+  lexer_tokenize(&lex, &file->tokens, pool);
+
+  times[PHASE_PARSE] = wall_time_ns();
+  size_t lexed = mempool_stats(pool).used;
+  Parser parser;
+  parser_init(&parser, file, pool, &bench->ast.scratch_pools[0]);
+  parse_ast(&parser);
+  bench->tokens = file->tokens.count;
+  bench->ast_bytes = mempool_stats(pool).used - lexed;
+
+  times[PHASE_DECLARE] = wall_time_ns();
+  ast_link_files(&bench->ast);
+  declare_fns(&bench->ast);
+  ssa_prog_declare_fns(&bench->prog, &bench->ast);
+  bench->fns = bench->ast.fns.items;
+  bench->exprs = 0;
+  for (size_t i = 0; i < bench->fns; i++) {
+    Function *fn = vector_idx(&bench->ast.fns, i);
+    bench->exprs += fn->exprs.count - 1;
+  }
+
+  times[PHASE_CHECK] = wall_time_ns();
+  check_fns(&bench->ast);
+  times[PHASE_TRANSLATE] = wall_time_ns();
+  translate_ast(&bench->ast, &bench->prog);
+  times[PHASE_COUNT] = wall_time_ns();
+
+  for (size_t i = 0; i < PHASE_COUNT; i++) {
+    uint64_t t = times[i + 1] - times[i];
+    if (best[i] == 0 || t < best[i]) {
+      best[i] = t;
+    }
+  }
+}
+
+static void
+write_json(FILE *file, const BeansGenParams *params, Bench *bench,
+           size_t jobs, uint64_t *best) {
+  fprintf(file, "{\n");
+  fprintf(file,
+          "  \"params\": {\"fns\": %zu, \"stmts\": %zu, \"depth\": %zu, "
+          "\"ident\": %zu, \"literals\": %u, \"seed\": %llu, \"jobs\": %zu},\n",
+          params->fns, params->stmts, params->depth, params->ident_len,
+          params->literal_pct, (unsigned long long)params->seed, jobs);
+  fprintf(file, "  \"bytes\": %zu,\n", bench->sz);
+  fprintf(file, "  \"tokens\": %zu,\n", bench->tokens);
+  fprintf(file, "  \"functions\": %zu,\n", bench->fns);
+  fprintf(file, "  \"exprs\": %zu,\n", bench->exprs);
+  fprintf(file, "  \"ast_bytes\": %zu,\n", bench->ast_bytes);
+  fprintf(file, "  \"phases\": {\n");
+  for (size_t i = 0; i < PHASE_COUNT; i++) {
+    double secs = best[i] / 1e9;
+    fprintf(file,
+            "    \"%s\": {\"seconds\": %.6f, \"mb_per_s\": %.3f, "
+            "\"tokens_per_s\": %.0f, \"fns_per_s\": %.0f}%s\n",
+            phase_names[i], secs, bench->sz / secs / 1e6,
+            bench->tokens / secs, bench->fns / secs,
+            i + 1 < PHASE_COUNT ? "," : "");
+  }
+  fprintf(file, "  }\n}\n");
+}
+
+int
+main(int argc, char *argv[]) {
+  BeansGenParams params;
+  beans_gen_default(&params);
+  argc = beans_gen_parse_args(&params, argc, argv);
+
+  int runs = 5;
+  size_t jobs = 1;
+  const char *json_path = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-runs") == 0 && i + 1 < argc) {
+      runs = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      jobs = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "-json") == 0 && i + 1 < argc) {
+      json_path = argv[++i];
+    } else {
+      log_err_final("unknown argument '%s'", argv[i]);
+    }
+  }
+  if (runs < 1 || jobs < 1) {
+    log_err_final("-runs and -j must be at least 1");
+  }
+
+  Bench bench;
+  char *src = beans_gen(&params, &bench.sz);
+  bench.src = (const uint8_t *)src;
+  interner_init(&bench.interner);
+  ast_init(&bench.ast, jobs);
+  ssa_prog_init(&bench.prog, jobs);
+
+  uint64_t best[PHASE_COUNT] = {0};
+  for (int i = 0; i < runs; i++) {
+    run_once(&bench, best);
+  }
+
+  printf("compile: %zu bytes, %zu tokens, %zu functions, %zu jobs\n",
+         bench.sz, bench.tokens, bench.fns, jobs);
+  printf("ast: %zu expressions, %zu bytes, %.1f bytes per expression\n",
+         bench.exprs, bench.ast_bytes, (double)bench.ast_bytes / bench.exprs);
+  for (size_t i = 0; i < PHASE_COUNT; i++) {
+    double secs = best[i] / 1e9;
+    printf("%-14s %9.3f ms %9.1f MB/s %9.2f Mtok/s %10.0f fns/s\n",
+           phase_names[i], secs * 1e3, bench.sz / secs / 1e6,
+           bench.tokens / secs / 1e6, bench.fns / secs);
+  }
+
+  if (json_path != NULL) {
+    FILE *file = fopen(json_path, "w");
+    if (file == NULL) {
+      log_err_final("unable to open '%s'", json_path);
+    }
+    write_json(file, &params, &bench, jobs, best);
+    fclose(file);
+  }
+
+  ssa_prog_deinit(&bench.prog);
+  ast_deinit(&bench.ast);
+  interner_deinit(&bench.interner);
+  free(src);
+  return EXIT_SUCCESS;
+}
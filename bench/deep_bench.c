@@ -0,0 +1,133 @@
+/* Deep expression benchmark.
+ *
+ * Compiles one function returning an expression of -terms terms, and the same
+ * function with half as many terms, for every shape below.  Every phase walks
+ * expressions without recursing, so doubling the terms should double the
+ * time; the benchmark fails if it grows by more than -max-ratio. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bcc2.h"
+#include "helper.h"
+
+typedef enum {
+  SHAPE_CHAIN,  /* a + a + a ..., deep along the left operand */
+  SHAPE_NESTED, /* (a + (a + (a ...))), deep along the right operand */
+  SHAPE_CALLS,  /* id(id(id(... a))) */
+  SHAPE_COUNT,
+} Shape;
+
+static const char *shape_names[] = {"chain", "nested", "calls"};
+
+static void
+append(char **out, const char *str) {
+  size_t len = strlen(str);
+  memcpy(*out, str, len);
+  *out += len;
+}
+
+/* source of a program with one expression of terms terms, malloc'd */
+static char *
+deep_gen(Shape shape, size_t terms, size_t *sz) {
+  /* no term takes more than 8 bytes */
+  char *src = malloc(terms * 8 + 128);
+  if (src == NULL) {
+    log_err_final("out of memory");
+  }
+  char *out = src;
+  append(&out, "id(a i32) i32 {\n  return a\n}\n");
+  append(&out, "deep(a i32) i32 {\n  return ");
+  for (size_t i = 0; i < terms; i++) {
+    switch (shape) {
+      case SHAPE_CHAIN:
+        append(&out, i + 1 < terms ? "a + " : "a");
+        break;
+      case SHAPE_NESTED:
+        append(&out, i + 1 < terms ? "(a + " : "a");
+        break;
+      case SHAPE_CALLS:
+        append(&out, "id(");
+        break;
+      case SHAPE_COUNT:
+        break;
+    }
+  }
+  if (shape == SHAPE_CALLS) {
+    append(&out, "a");
+  }
+  for (size_t i = 0; i < terms; i++) {
+    if (shape == SHAPE_CALLS || (shape == SHAPE_NESTED && i + 1 < terms)) {
+      append(&out, ")");
+    }
+  }
+  append(&out, "\n}\n");
+  *sz = out - src;
+  return src;
+}
+
+/* best time of runs compiles, in nanoseconds */
+static uint64_t
+time_compile(Bcc2Compiler *cc, Shape shape, size_t terms, int runs) {
+  Bcc2Source source;
+  source.path = shape_names[shape];
+  source.src = (const uint8_t *)deep_gen(shape, terms, &source.sz);
+
+  uint64_t best = 0;
+  for (int i = 0; i < runs; i++) {
+    Diagnostic diag;
+    uint64_t start = wall_time_ns();
+    if (bcc2_compile(cc, &source, 1, &diag) == NULL) {
+      log_err_final("%s: %s", shape_names[shape], diag.msg);
+    }
+    uint64_t t = wall_time_ns() - start;
+    if (best == 0 || t < best) {
+      best = t;
+    }
+  }
+  free((void *)source.src);
+  return best;
+}
+
+int
+main(int argc, char *argv[]) {
+  size_t terms = 1000000;
+  int runs = 3;
+  double max_ratio = 3.0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-terms") == 0 && i + 1 < argc) {
+      terms = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "-runs") == 0 && i + 1 < argc) {
+      runs = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-max-ratio") == 0 && i + 1 < argc) {
+      max_ratio = strtod(argv[++i], NULL);
+    } else {
+      log_err_final("unknown argument '%s'", argv[i]);
+    }
+  }
+  if (runs < 1 || terms < 2) {
+    log_err_final("-runs must be at least 1 and -terms at least 2");
+  }
+
+  Bcc2Compiler cc;
+  bcc2_init(&cc, 1);
+
+  int failed = 0;
+  printf("%-8s %12s %12s %10s %8s\n", "shape", "half ms", "full ms",
+         "ns/term", "ratio");
+  for (Shape shape = 0; shape < SHAPE_COUNT; shape++) {
+    uint64_t half = time_compile(&cc, shape, terms / 2, runs);
+    uint64_t full = time_compile(&cc, shape, terms, runs);
+    double ratio = (double)full / half;
+    printf("%-8s %12.3f %12.3f %10.1f %8.2f\n", shape_names[shape],
+           half / 1e6, full / 1e6, (double)full / terms, ratio);
+    if (ratio > max_ratio) {
+      log_err("%s: doubling the terms took %.2f times as long",
+              shape_names[shape], ratio);
+      failed = 1;
+    }
+  }
+
+  bcc2_deinit(&cc);
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
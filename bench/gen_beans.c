@@ -0,0 +1,25 @@
+/* Writes a synthetic Beans program to stdout, for running bcc2 itself on
+ * large inputs:
+ *
+ *   gen_beans -fns 100000 -depth 6 > big.bn
+ *   bcc2 big.bn -time-report */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "beans_gen.h"
+#include "helper.h"
+
+int
+main(int argc, char *argv[]) {
+  BeansGenParams params;
+  beans_gen_default(&params);
+  if (beans_gen_parse_args(&params, argc, argv) != 1) {
+    log_err_final("unknown argument '%s'", argv[1]);
+  }
+
+  size_t sz;
+  char *src = beans_gen(&params, &sz);
+  fwrite(src, 1, sz, stdout);
+  free(src);
+  return EXIT_SUCCESS;
+}
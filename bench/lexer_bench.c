@@ -0,0 +1,89 @@
+/* Lexer throughput microbenchmark.
+ *
+ * Lexes a synthetic Beans source held in memory and reports the throughput in
+ * MB/s.  meson builds this twice, once with the vectorized scanning loops and
+ * once with BCC2_SCALAR_LEXER, so the two paths can be compared directly. */
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "helper.h"
+#include "lexer.h"
+
+static const char sample[] =
+    "compute_checksum_for_block(block_index i64, previous_value u64) u64 {\n"
+    "\tlet accumulated_total = previous_value * 31u64 + 4099u64\n"
+    "\tmut scratch_register: u64 = accumulated_total / 7u64\n"
+    "\tlet unused_result = helper_function_with_long_name(scratch_register, "
+    "1234567890u64)\n"
+    "\t\t\t\t\t\t\t\t\t\t\t\t\n"
+    "        let indented_with_spaces = block_index - 12345678i64\n"
+    "\treturn accumulated_total + scratch_register * 1000000007u64\n"
+    "}\n\n";
+
+/* identifiers and indentation long enough that most runs span whole
+ * vectors, selected with a third argument of 'long' */
+static const char long_sample[] =
+    "accumulate_the_checksum_of_every_block_in_the_input_buffer_x(b i64) "
+    "i64 {\n"
+    "                                                                let "
+    "accumulate_the_checksum_of_every_block_in_the_input_buffer_y = b * "
+    "accumulate_the_checksum_of_every_block_in_the_input_buffer_z\n"
+    "                                                                return "
+    "accumulate_the_checksum_of_every_block_in_the_input_buffer_y\n"
+    "}\n\n";
+
+static double
+now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+main(int argc, char *argv[]) {
+  size_t mb = argc > 1 ? strtoul(argv[1], NULL, 10) : 64;
+  int runs = argc > 2 ? atoi(argv[2]) : 5;
+  int long_tokens = argc > 3 && strcmp(argv[3], "long") == 0;
+  const char *text = long_tokens ? long_sample : sample;
+  size_t text_sz = long_tokens ? sizeof(long_sample) - 1 : sizeof(sample) - 1;
+
+  size_t sz = mb * 1024 * 1024;
+  uint8_t *buf = malloc(sz);
+  if (buf == NULL) {
+    log_err_final("unable to allocate %zu bytes", sz);
+  }
+  size_t filled = 0;
+  while (filled + text_sz <= sz) {
+    memcpy(buf + filled, text, text_sz);
+    filled += text_sz;
+  }
+
+  Interner interner;
+  interner_init(&interner);
+
+  double best = 0;
+  size_t tokens = 0;
+  for (int i = 0; i < runs; i++) {
+    double start = now();
+    Lexer lex;
+    lexer_init(&lex, buf, filled, &interner);
+    tokens = 0;
+    while (lexer_next(&lex).t != TOK_EOF) {
+      tokens++;
+    }
+    double elapsed = now() - start;
+    if (best == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+
+  printf("lexer (%s): %zu bytes, %zu tokens, %.1f MB/s, %.1f Mtok/s\n",
+         lexer_scan_impl, filled, tokens, filled / best / 1e6,
+         tokens / best / 1e6);
+  interner_deinit(&interner);
+  free(buf);
+  return EXIT_SUCCESS;
+}
@@ -6,6 +6,7 @@
 #include <stdio.h>
 
 #include "helper.h"
+#include "jobs.h"
 #include "lexer.h"
 #include "symtable.h"
 #include "type.h"
@@ -33,30 +34,83 @@ typedef enum {
   EXPR_FUNCALL,
 } ExprKind;
 
-typedef struct Expr {
-  ExprKind t;
-  SourcePosition pos;
-
-  Type *type;
-  union {
-    struct {
-      struct Expr *left;
-      struct Expr *right;
-      BinopKind op;
-    } binop;
-    ScopeEntry *var;
-    struct {
-      uint64_t val;
-      IntlitKind type;
-    } intlit;
-    struct {
-      SourcePosition name;
-      ScopeEntry *fn;
-      Vector args; /* Expr* */
-    } funcall;
-  } data;
-
-} Expr;
+/* Index of an expression in the ExprTable of its function */
+typedef uint32_t ExprId;
+
+/* never a valid expression, the first entry of every table is unused */
+#define EXPR_NONE 0
+
+/* The expressions of one function, stored as one array per field so that
+ * passes walk dense memory.  What a and b hold depends on the kind:
+ *
+ *   EXPR_INT      low and high half of the value, sub is the IntlitKind
+ *   EXPR_VAR      the atom and an index in entries
+ *   EXPR_BINOP    the left and right operand, sub is the BinopKind
+ *   EXPR_FUNCALL  an index in extra and an index in entries, extra holds
+ *                 the atom, the length of the name, the number of arguments
+ *                 and then the arguments
+ *
+ * Nodes are stored in the order the parser finishes them, which is the
+ * order they are evaluated in: the operands of a node come before it, and
+ * the expression of a statement is the range of nodes ending at its root. */
+typedef struct {
+  const uint8_t *src; /* positions are offsets into it */
+  uint32_t count;
+  uint8_t *kinds; /* ExprKind */
+  uint8_t *subs;
+  uint32_t *a;
+  uint32_t *b;
+  uint32_t *pos_offs;
+  uint32_t *pos_lens;
+  Type **types; /* set by check_fns */
+  uint32_t *extra;
+  ScopeEntry **entries; /* set by check_fns */
+} ExprTable;
+
+static inline ExprKind
+expr_kind(const ExprTable *exprs, ExprId expr) {
+  return exprs->kinds[expr];
+}
+
+static inline SourcePosition
+expr_pos(const ExprTable *exprs, ExprId expr) {
+  SourcePosition pos = {exprs->src + exprs->pos_offs[expr],
+                        exprs->pos_lens[expr]};
+  return pos;
+}
+
+static inline uint64_t
+expr_int_val(const ExprTable *exprs, ExprId expr) {
+  return exprs->a[expr] | (uint64_t)exprs->b[expr] << 32;
+}
+
+/* ScopeEntry of a variable or of the function called */
+static inline ScopeEntry **
+expr_entry(const ExprTable *exprs, ExprId expr) {
+  return &exprs->entries[exprs->b[expr]];
+}
+
+static inline Atom
+expr_call_atom(const ExprTable *exprs, ExprId expr) {
+  return exprs->extra[exprs->a[expr]];
+}
+
+static inline SourcePosition
+expr_call_name(const ExprTable *exprs, ExprId expr) {
+  SourcePosition pos = {exprs->src + exprs->pos_offs[expr],
+                        exprs->extra[exprs->a[expr] + 1]};
+  return pos;
+}
+
+static inline uint32_t
+expr_call_nargs(const ExprTable *exprs, ExprId expr) {
+  return exprs->extra[exprs->a[expr] + 2];
+}
+
+static inline const ExprId *
+expr_call_args(const ExprTable *exprs, ExprId expr) {
+  return &exprs->extra[exprs->a[expr] + 3];
+}
 
 typedef enum {
   STMT_LET,
@@ -71,17 +125,25 @@ typedef struct {
   union {
     struct {
       SourcePosition name;
+      Atom atom;
       int mut;
       ScopeEntry *var;
       Type *type;
-      Expr *value; /* null if variable is not initialized on declaration */
+      /* EXPR_NONE if variable is not initialized on declaration */
+      ExprId value;
     } let;
 
-    Expr *expr;
-    Expr *ret;
+    ExprId expr;
+    ExprId ret;
   } data;
 } Stmt;
 
+/* Root of the expression of stmt, EXPR_NONE if it has none */
+static inline ExprId
+stmt_expr(const Stmt *stmt) {
+  return stmt->t == STMT_LET ? stmt->data.let.value : stmt->data.expr;
+}
+
 typedef struct {
   SourcePosition pos;
   Vector stmts; /* Stmt */
@@ -90,27 +152,74 @@ typedef struct {
 typedef struct {
   Type *type;
   SourcePosition name;
+  Atom atom;
   ScopeEntry *entry;
 } Param;
 
 typedef struct {
   SourcePosition pos;
   SourcePosition name;
+  Atom atom;
   Block body;
   ScopeEntry *entry;
   Vector params; /* Param */
   Type *ret_type;
   Scope *scope;
+  ExprTable exprs;
+
+  /* tokens [tok_start, tok_end) of toks make up the function */
+  const TokenBuffer *toks;
+  uint32_t tok_start;
+  uint32_t tok_end;
+  /* the SSA was loaded from the cache, so the per-function passes skip it */
+  int cached;
 } Function;
 
+/* One input of a compilation.  Files are parsed independently, into the pool
+ * of the worker that parses them, and then linked into the AST. */
 typedef struct {
-  const uint8_t *src_base;
-  MemPool pool; /* used to allocate structures that belong to this AST */
-  Vector fns;   /* Function */
+  const char *path;
+  const uint8_t *src;
+  size_t sz;
+  TokenBuffer tokens;
+  Vector fns; /* Function, moved into the AST by ast_link_files */
+} SourceFile;
+
+typedef struct {
+  Vector files;  /* SourceFile */
+  MemPool *pool; /* used to allocate structures that belong to this AST */
+  Vector fns;    /* Function, from every file in order */
   Scope *global;
+
+  /* Passes run functions on this many threads, and each thread allocates
+   * from its own pool instead of pool.  Scratch pools hold what a worker only
+   * needs while it is working on one function. */
+  size_t nworkers;
+  JobPool jobs; /* the threads, kept until ast_deinit */
+  MemPool *worker_pools;
+  MemPool *scratch_pools;
+  MemPool *own_pools; /* NULL if the pools belong to the caller */
 } AST;
 
+/* Number of pools an AST uses */
+#define AST_POOL_COUNT(nworkers) (1 + 2 * (nworkers))
+
 void ast_deinit(AST *ast);
-void ast_init(AST *ast, const uint8_t *src_base);
+/* Maps AST_POOL_COUNT(nworkers) new pools */
+void ast_init(AST *ast, size_t nworkers);
+/* Allocates from pools[0] and uses the next nworkers pools as worker pools
+ * and the nworkers after them as scratch pools.  The pools are reset by the
+ * AST but never unmapped. */
+void ast_init_pools(AST *ast, MemPool *pools, size_t nworkers);
+/* Drops every file and node but keeps the pools and their committed memory,
+ * so the AST can be reused for another compilation */
+void ast_reset(AST *ast);
+/* The returned file is only valid until the next call */
+SourceFile *ast_add_file(AST *ast, const char *path, const uint8_t *src,
+                         size_t sz);
+/* Appends the functions of every file to fns, once they are all parsed */
+void ast_link_files(AST *ast);
+/* Start of the source containing pos, for log_source_err */
+const uint8_t *ast_src_base(AST *ast, SourcePosition pos);
 void ast_dump(FILE *file, AST *ast);
 #endif
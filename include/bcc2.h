@@ -0,0 +1,65 @@
+#ifndef BCC2_H
+#define BCC2_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ast.h"
+#include "helper.h"
+#include "intern.h"
+#include "ssa.h"
+
+typedef struct Bcc2Compiler Bcc2Compiler;
+
+/* Phases of bcc2_compile, in the order they run */
+typedef enum {
+  BCC2_PHASE_PARSE,     /* every file is parsed and linked into the AST */
+  BCC2_PHASE_DECLARE,   /* every function is declared in the AST and SSA */
+  BCC2_PHASE_CHECK,     /* every function body is checked */
+  BCC2_PHASE_TRANSLATE, /* every function is translated to SSA */
+} Bcc2Phase;
+
+/* Called on the compiling thread once each phase is done.  A hook may look at
+ * and change the AST and the program of cc, and errors it reports through the
+ * log functions end the compile like any other error. */
+typedef void (*Bcc2Hook)(void *ctx, Bcc2Compiler *cc, Bcc2Phase phase);
+
+/* Library interface to the compiler.  A compiler owns all the state of a
+ * compilation, so separate compilers can run on separate threads at once.
+ * It keeps its pools between compilations, which makes reusing one compiler
+ * much cheaper than creating a new one. */
+struct Bcc2Compiler {
+  Interner interner;
+  AST ast;
+  SSA_Prog prog;
+  MemPool *own_pools; /* NULL if the pools belong to the caller */
+  Bcc2Hook hook;      /* NULL if there is none */
+  void *hook_ctx;
+};
+
+typedef struct {
+  const char *path; /* only used to name the source in diagnostics */
+  const uint8_t *src;
+  size_t sz;
+} Bcc2Source;
+
+/* Compiles use nworkers threads, nworkers must be at least 1 */
+void bcc2_init(Bcc2Compiler *cc, size_t nworkers);
+/* Number of pools bcc2_init_pools needs for nworkers */
+size_t bcc2_pool_count(size_t nworkers);
+/* Allocates only from the bcc2_pool_count(nworkers) pools, which must be
+ * initialized.  They are reset by the compiler but never unmapped. */
+void bcc2_init_pools(Bcc2Compiler *cc, MemPool *pools, size_t nworkers);
+void bcc2_deinit(Bcc2Compiler *cc);
+/* Installs hook for every later compile with cc, NULL removes it */
+void bcc2_set_hook(Bcc2Compiler *cc, Bcc2Hook hook, void *ctx);
+
+/* Compiles the sources as one program.  Returns the SSA of the program, which
+ * is valid until the next compile with cc, or NULL and fills diag on the first
+ * error.  If diag is NULL errors are printed and exit instead, as the log
+ * functions do outside of a DiagSink.  The sources must outlive the
+ * result. */
+SSA_Prog *bcc2_compile(Bcc2Compiler *cc, const Bcc2Source *srcs, size_t nsrcs,
+                       Diagnostic *diag);
+
+#endif
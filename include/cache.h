@@ -0,0 +1,37 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ast.h"
+#include "platforms.h"
+#include "ssa.h"
+
+typedef struct {
+  uint64_t lo;
+  uint64_t hi;
+} CacheKey;
+
+/* On-disk cache of translated functions.  A function is keyed by its tokens,
+ * the signatures of the functions it names and the platform, so a hit always
+ * translates to the same SSA. */
+typedef struct {
+  const char *dir;
+  const Platform *platform;
+  int load;       /* 0 to only fill the cache */
+  CacheKey *keys; /* indexed like ast->fns */
+  size_t hits;
+  size_t misses;
+} FnCache;
+
+/* Creates dir if it does not exist yet */
+void fn_cache_init(FnCache *cache, const char *dir, const Platform *platform,
+                   int load);
+/* Must run after declare_fns and ssa_prog_declare_fns.  Fills the SSA_Fn of
+ * every function found in the cache and marks it as cached. */
+void fn_cache_load(FnCache *cache, AST *ast, SSA_Prog *prog);
+/* Writes every function that was not loaded, once it is translated */
+void fn_cache_store(FnCache *cache, AST *ast, SSA_Prog *prog);
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef HELPER_H
 #define HELPER_H
 
+#include <setjmp.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -12,7 +13,11 @@ typedef struct {
 SourcePosition combine_pos(SourcePosition pos1, SourcePosition pos2);
 SourcePosition make_pos(const uint8_t *buf, size_t sz);
 
-int64_t next_vn();
+/* non-cryptographic 64 bit hash, well mixed in every bit */
+uint64_t hash_bytes(const uint8_t *data, size_t sz, uint64_t seed);
+
+/* counter holds the last value number handed out, start it at 0 */
+int64_t next_vn(int64_t *counter);
 
 void log_err(const char *fmt, ...);
 
@@ -27,16 +32,104 @@ void actual_log_internal_err(const char *fmt, const char *file, size_t line,
 
 void log_source_err(const char *fmt, const uint8_t *base, SourcePosition, ...);
 
+typedef enum {
+  DIAG_ERROR,
+  DIAG_INTERNAL,
+} DiagKind;
+
+typedef struct {
+  DiagKind kind;
+  /* source the error is in, NULL if the error has no position */
+  const uint8_t *src;
+  const char *path; /* name of src, only filled in by bcc2_compile */
+  size_t line;   /* starts at 1 */
+  size_t column; /* starts at 1 */
+  char msg[256];
+  /* where in the compiler an internal error was raised, NULL otherwise */
+  const char *file;
+  size_t file_line;
+} Diagnostic;
+
+/* While a sink is installed on a thread, the final log functions store their
+ * error in diag and longjmp to env instead of exiting:
+ *
+ *   DiagSink sink;
+ *   DiagSink *prev = diag_sink_set(&sink);
+ *   if (setjmp(sink.env) == 0) {
+ *     ...
+ *   } else {
+ *     ... report sink.diag ...
+ *   }
+ *   diag_sink_set(prev);
+ *
+ * Memory allocated before the error stays in its pool. */
+typedef struct {
+  jmp_buf env;
+  Diagnostic diag;
+} DiagSink;
+
+/* returns the sink that was installed before */
+DiagSink *diag_sink_set(DiagSink *sink);
+DiagSink *diag_sink_get(void);
+/* reports an error caught on another thread as if it happened on this one */
+void diag_rethrow(const Diagnostic *diag);
+/* prints diag the way the log function that raised it does, and exits */
+void diag_report_final(const Diagnostic *diag);
+
+/* monotonic time and CPU time used by the whole process, in nanoseconds */
+uint64_t wall_time_ns(void);
+uint64_t cpu_time_ns(void);
+
+/* Maps a whole file read-only, release it with munmap */
+const uint8_t *map_file(const char *path, size_t *size);
+
+/* Bump allocator over a reserved range of address space.  Pages are only
+ * committed as the pool grows. */
 typedef struct {
   uint8_t *base;
-  size_t alloc;
-  size_t size;
+  size_t reserved;   /* bytes of address space */
+  size_t alloc;      /* bytes committed */
+  size_t size;       /* bytes in use */
+  size_t high_water; /* largest size reached */
 } MemPool;
 
+/* returned by mempool_mark, to throw away everything allocated after it */
+typedef size_t MemPoolMark;
+
+typedef struct {
+  size_t reserved;
+  size_t committed;
+  size_t used;
+  size_t high_water;
+} MemPoolStats;
+
+/* alignment of mempool_alloc, enough for every structure in the compiler */
+#define POOL_ALIGN 8
+
 void mempool_init(MemPool *pool);
+/* for pools that are known to stay small, reserve is rounded up to 2 MiB */
+void mempool_init_reserve(MemPool *pool, size_t reserve);
 void *mempool_alloc(MemPool *pool, size_t amount);
+/* align must be a power of two */
+void *mempool_alloc_aligned(MemPool *pool, size_t amount, size_t align);
 void mempool_deinit(MemPool *pool);
 
+/* Resizes ptr in place if it is the last allocation in the pool, returns 0
+ * and leaves it untouched otherwise */
+int mempool_resize_last(MemPool *pool, void *ptr, size_t old_sz,
+                        size_t new_sz);
+
+/* Memory allocated after the mark is reused by later allocations once it is
+ * released, and is not zeroed again. */
+MemPoolMark mempool_mark(MemPool *pool);
+void mempool_release(MemPool *pool, MemPoolMark mark);
+
+MemPoolStats mempool_stats(MemPool *pool);
+
+/* n initialized pools in an array from malloc */
+MemPool *mempool_alloc_array(size_t n);
+void mempool_free_array(MemPool *pools, size_t n);
+
 typedef struct {
   MemPool *pool;
   uint8_t *data;
@@ -47,6 +140,11 @@ typedef struct {
 
 void vector_init(Vector *vec, size_t it_sz, MemPool *pool);
 void vector_init_size(Vector *vec, size_t it_sz, MemPool *pool, size_t items);
+/* makes room for at least items without growing again */
+void vector_reserve(Vector *vec, size_t items);
+/* gives unused capacity back to the pool if the vector is the last
+ * allocation, call once a vector is done growing */
+void vector_freeze(Vector *vec);
 void vector_push(Vector *vec, void *data);
 void vector_remove(Vector *vec, size_t idx);
 void vector_insert(Vector *vec, size_t idx, void *data);
@@ -0,0 +1,68 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "helper.h"
+
+/* Identifies an interned identifier, two identifiers with the same spelling
+ * always get the same atom.  0 is never a valid atom. */
+typedef uint32_t Atom;
+
+typedef struct {
+  uint32_t hash; /* hash of the spelling */
+  Atom atom;     /* 0 if the slot is empty */
+} InternSlot;
+
+/* log2 of the number of shards, the low bits of atom - 1 name the shard */
+#define INTERN_SHARD_BITS 4
+#define INTERN_SHARDS (1 << INTERN_SHARD_BITS)
+
+/* A separately locked part of the table, so that lexers running on
+ * different threads rarely wait for each other */
+typedef struct {
+  pthread_mutex_t lock;
+  size_t nslots; /* power of two */
+  InternSlot *slots;
+  Vector names; /* SourcePosition, indexed by (atom - 1) >> INTERN_SHARD_BITS */
+} InternShard;
+
+/* Maps identifier spellings to atoms.  An Interner is shared by every lexer
+ * of a compilation so that atoms can be compared across sources, and may be
+ * used from several threads at once. */
+typedef struct {
+  InternShard shards[INTERN_SHARDS];
+  /* shared by the shards, pool_lock is taken after the lock of a shard */
+  pthread_mutex_t pool_lock;
+  MemPool *pool;
+  MemPool own_pool;
+  int owns_pool;
+} Interner;
+
+void interner_init(Interner *interner);
+/* allocates from pool, which is reset but never unmapped by the interner */
+void interner_init_pool(Interner *interner, MemPool *pool);
+void interner_deinit(Interner *interner);
+/* Forgets every atom but keeps the pools, the sources of the old atoms may
+ * be freed afterwards */
+void interner_reset(Interner *interner);
+
+Atom intern(Interner *interner, SourcePosition name);
+SourcePosition atom_name(Interner *interner, Atom atom);
+
+/* Hash for tables keyed by atoms.  Atoms are dense, so mixing the bits of the
+ * id is enough and avoids rehashing the spelling. */
+static inline uint32_t
+atom_hash(Atom atom) {
+  uint32_t h = atom;
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+#endif
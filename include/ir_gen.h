@@ -4,6 +4,15 @@
 #include "ast.h"
 #include "ssa.h"
 
+/* Creates an empty SSA_Fn for every function, so that calls and the cache can
+ * refer to them before they are translated.  Later passes over prog run on
+ * the threads of ast. */
+void ssa_prog_declare_fns(SSA_Prog *prog, AST *ast);
 void translate_ast(AST *ast, SSA_Prog *prog);
+/* Translates fn into sem_fn, which must have been declared.  The SSA is
+ * allocated from pool and never refers to the AST of fn, so it can be freed
+ * afterwards.  scratch only holds data needed while translating fn. */
+void translate_function(Function *fn, SSA_Fn *sem_fn, MemPool *pool,
+                        MemPool *scratch);
 
 #endif
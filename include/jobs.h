@@ -0,0 +1,49 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* worker is in [0, nworkers) and is only used by one thread at a time, so it
+ * can index per-worker state such as memory pools */
+typedef void (*JobFn)(void *ctx, size_t idx, size_t worker);
+
+struct JobQueue;
+
+/* Threads that stay alive between calls to parallel_for, so that a pass does
+ * not pay for creating and joining them.  Workers 1 to nworkers - 1 each have
+ * a thread, the thread calling parallel_for is worker 0. */
+typedef struct {
+  size_t nworkers;
+  pthread_t *threads;
+  pthread_mutex_t lock;
+  pthread_cond_t posted; /* a queue was posted or the pool is stopping */
+  pthread_cond_t done;   /* the last worker of the queue is done */
+  struct JobQueue *queue;
+  uint64_t generation;   /* bumped for every posted queue */
+  size_t posted_workers; /* workers taking part in queue */
+  size_t busy;           /* threads still working on queue */
+  int stop;
+} JobPool;
+
+/* Starts nworkers - 1 threads, nworkers must be at least 1 */
+void job_pool_init(JobPool *pool, size_t nworkers);
+void job_pool_deinit(JobPool *pool);
+
+/* Calls fn once for every index in [0, n), spread over the workers of pool.
+ * Returns once every call has finished.  Runs on the calling thread when pool
+ * is NULL or has one worker.  Only one thread may use a pool at a time.
+ *
+ * An error in a job stops the indices after it from starting, while those
+ * before it still run.  Once they are done the error of the lowest failing
+ * index is passed to the caller's sink, or printed before exiting if there is
+ * none, so the error reported does not depend on the number of workers. */
+void parallel_for(JobPool *pool, size_t n, JobFn fn, void *ctx);
+
+/* While times is installed on a thread, parallel_for calls made from it add
+ * the time taken by the job for idx to times[idx], in nanoseconds.  Returns
+ * the array that was installed before. */
+uint64_t *job_times_set(uint64_t *times);
+
+#endif
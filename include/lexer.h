@@ -5,6 +5,7 @@
 #include <stdint.h>
 
 #include "helper.h"
+#include "intern.h"
 
 typedef enum {
   /* binary ops */
@@ -77,12 +78,53 @@ typedef enum {
 typedef struct {
   TokKind t;
   IntlitKind intlit_type;
+  Atom atom; /* only set for TOK_SYM */
   SourcePosition pos;
 } Token;
 
-void lexer_init(const uint8_t *buf, size_t sz);
+/* name of the scanning loops compiled in: "avx2", "sse2" or "scalar" */
+extern const char *const lexer_scan_impl;
 
-Token lexer_next();
-Token lexer_peek();
+/* Every token of a source, stored as parallel arrays so that walking the
+ * kinds only touches one byte per token.  The last token is always TOK_EOF. */
+typedef struct {
+  const uint8_t *src;
+  size_t count;
+  uint8_t *kinds;        /* TokKind */
+  uint8_t *intlit_types; /* IntlitKind, only meaningful for TOK_INT */
+  Atom *atoms;           /* only meaningful for TOK_SYM */
+  uint32_t *offsets;     /* start of the lexeme, relative to src */
+  uint32_t *lens;
+} TokenBuffer;
+
+/* All of the state of a lexer, so that several sources can be lexed at the
+ * same time */
+typedef struct {
+  const uint8_t *buf;
+  size_t sz;
+  Interner *interner; /* symbols are interned as they are lexed */
+
+  size_t end;
+  size_t start;
+
+  int prev;
+  Token peek;
+  int peekf; /* 0 if no token available to peek */
+} Lexer;
+
+void lexer_init(Lexer *lex, const uint8_t *buf, size_t sz,
+                Interner *interner);
+
+Token lexer_next(Lexer *lex);
+Token lexer_peek(Lexer *lex);
+
+/* Tokenizes the rest of the input in one pass, the arrays are allocated from
+ * pool */
+void lexer_tokenize(Lexer *lex, TokenBuffer *toks, MemPool *pool);
+
+static inline SourcePosition
+token_pos(const TokenBuffer *toks, size_t idx) {
+  return make_pos(toks->src + toks->offsets[idx], toks->lens[idx]);
+}
 
 #endif
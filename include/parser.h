@@ -3,7 +3,39 @@
 
 #include "ast.h"
 
-/* lexer must be initialized previous to calling this function */
-AST parse_ast();
+/* All of the state of a parser, so that several sources can be parsed at the
+ * same time */
+typedef struct {
+  SourceFile *file;
+  MemPool *pool; /* nodes are allocated from here */
+  const TokenBuffer *toks;
+  size_t cur; /* index of the next token */
+
+  /* The expressions of the current function are built here and copied into
+   * its ExprTable once it is parsed */
+  MemPool *scratch;
+  Vector nodes; /* ExprNode */
+  Vector extra; /* uint32_t */
+  Vector args;   /* ExprId, arguments of the calls being parsed */
+  Vector frames; /* work stack of parse_expr */
+  uint32_t nentries;
+} Parser;
+
+/* file->tokens must be filled by lexer_tokenize before calling this, the
+ * parsed functions are put in file->fns.  scratch is released after every
+ * function. */
+void parser_init(Parser *parser, SourceFile *file, MemPool *pool,
+                 MemPool *scratch);
+void parse_ast(Parser *parser);
+
+/* Parses toks, which may only hold part of file, one function at a time with
+ * parse_fn or parse_fn_sig.  file->fns is left alone. */
+void parser_init_tokens(Parser *parser, SourceFile *file,
+                        const TokenBuffer *toks, MemPool *pool,
+                        MemPool *scratch);
+void parse_fn(Parser *parser, Function *function);
+/* only parses the name, parameters and return type, and stops before the
+ * body */
+void parse_fn_sig(Parser *parser, Function *function);
 
 #endif
@@ -4,8 +4,13 @@
 #include "ast.h"
 
 Type *coerce_type(int op, Type **left, Type **right, MemPool *pool);
-void resolve_names(AST *ast);
-void resolve_types(AST *ast);
-void check_returns(AST *ast);
+/* Adds every function and its signature to the global scope, runs before
+ * check_fns */
+void declare_fns(AST *ast);
+/* Resolves names, assigns types and checks returns in one walk over each
+ * function */
+void check_fns(AST *ast);
+/* check_fns for a single function, locals are allocated from pool */
+void check_fn(AST *ast, Function *fn, MemPool *pool);
 
 #endif
@@ -0,0 +1,28 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stddef.h>
+
+/* largest source a client may send, well below the 4 GiB that 32 bit token
+ * offsets allow */
+#define SERVER_MAX_SOURCE_SZ ((size_t)1 << 30)
+
+/* Serves compile requests on a Unix socket until the process is killed.
+ * Every client gets its own thread, and compiles use nworkers threads each.
+ *
+ * A client sends any number of requests on one connection:
+ *
+ *   file <path>\n          compiles the file at path
+ *   source <size>\n<data>  compiles the next size bytes
+ *
+ * and gets one reply per request:
+ *
+ *   ok <size>\n<data>                        the ir dump of the program
+ *   error <path>:<line>:<column>: <message>\n
+ *
+ * path is '-' for sources sent over the socket, line and column are 0 for
+ * errors without a position.  Sources larger than SERVER_MAX_SOURCE_SZ get an
+ * error reply without being compiled. */
+void run_server(const char *socket_path, size_t nworkers);
+
+#endif
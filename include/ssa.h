@@ -5,6 +5,7 @@
 #include <stdio.h>
 
 #include "helper.h"
+#include "jobs.h"
 
 typedef uint64_t RegId;
 
@@ -67,11 +68,22 @@ struct SSA_Fn {
   Vector params; /* RegId */
   Vector regs;   /* SSA_Reg */
   SourcePosition name;
+  /* has no effect besides its result and always returns, so an unused call
+   * to it can be removed.  Only set by ssa_find_pure_fns. */
+  int pure;
 };
 
 typedef struct {
-  MemPool pool;
+  MemPool *pool;
   Vector fns; /* SSA_Function */
+
+  /* one per worker thread, functions are allocated from the pool of the
+   * worker that translated them */
+  size_t nworkers;
+  MemPool *worker_pools;
+  MemPool *own_pools; /* NULL if the pools belong to the caller */
+  /* threads of the AST the functions were declared from, NULL before */
+  JobPool *jobs;
 } SSA_Prog;
 
 SSA_BBlock *bblock_init(MemPool *pool);
@@ -87,6 +99,14 @@ void bblock_replace_reg(SSA_BBlock *block, RegId find, RegId replace,
 
 RegId ssa_new_reg(SSA_Fn *fn, int sz);
 
+/* Maps 1 + nworkers new pools, nworkers must match the AST the program is
+ * translated from */
+void ssa_prog_init(SSA_Prog *prog, size_t nworkers);
+/* Like ast_init_pools */
+void ssa_prog_init_pools(SSA_Prog *prog, MemPool *pools, size_t nworkers);
+/* Drops every function but keeps the pools and their committed memory */
+void ssa_prog_reset(SSA_Prog *prog);
+void ssa_prog_deinit(SSA_Prog *prog);
 void ssa_prog_dump(FILE *file, SSA_Prog *prog, int reg_dump);
 
 #endif
@@ -0,0 +1,86 @@
+#ifndef SSA_BIN_H
+#define SSA_BIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ssa.h"
+
+/* Binary form of an SSA_Prog that is used in place once it is mapped.  Every
+ * reference is an offset relative to the field holding it, so a file can be
+ * mapped at any address and read without a parse step.  Everything is 8 byte
+ * aligned and in host byte order. */
+
+#define SSA_BIN_MAGIC 0x32426353 /* "ScB2" */
+/* bump whenever the layout changes */
+#define SSA_BIN_VERSION 1
+
+typedef int64_t SSA_BinOff;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t size; /* of the whole file */
+  uint32_t nfns;
+  uint32_t pad;
+  SSA_BinOff fns; /* SSA_BinFn[nfns] */
+} SSA_BinHeader;
+
+typedef struct {
+  SSA_BinOff name; /* name_sz bytes, not NUL terminated */
+  uint32_t name_sz;
+  uint32_t nparams;
+  SSA_BinOff params; /* RegId[nparams] */
+  uint32_t nregs;
+  uint32_t nblocks;
+  SSA_BinOff regs;   /* SizeKind as uint8_t[nregs] */
+  SSA_BinOff blocks; /* SSA_BinBlock[nblocks], in order */
+} SSA_BinFn;
+
+typedef struct {
+  uint32_t ninsts;
+  uint32_t pad;
+  SSA_BinOff insts; /* SSA_BinInst[ninsts] */
+} SSA_BinBlock;
+
+typedef struct {
+  uint8_t t;  /* InstKind */
+  uint8_t sz; /* SizeKind */
+  uint16_t pad;
+  uint32_t nargs; /* only used by INST_CALLFN */
+  RegId result;
+  union {
+    RegId operands[2];
+    struct {
+      uint64_t fn;     /* index into the fns of the header */
+      SSA_BinOff args; /* RegId[nargs] */
+    } callfn;
+    uint64_t imm;
+  } data;
+} SSA_BinInst;
+
+/* A mapped and validated file */
+typedef struct {
+  const SSA_BinHeader *header;
+  size_t size;
+} SSA_Bin;
+
+static inline const void *
+ssa_bin_ptr(const SSA_BinOff *off) {
+  return (const uint8_t *)off + *off;
+}
+
+static inline const SSA_BinFn *
+ssa_bin_fn(const SSA_Bin *bin, size_t idx) {
+  return (const SSA_BinFn *)ssa_bin_ptr(&bin->header->fns) + idx;
+}
+
+void ssa_bin_write(const char *path, SSA_Prog *prog);
+/* Maps path and checks that every offset in it stays inside of the file */
+void ssa_bin_load(SSA_Bin *bin, const char *path);
+void ssa_bin_unload(SSA_Bin *bin);
+/* Prints the same text as ssa_prog_dump does for the original program */
+void ssa_bin_dump(FILE *file, const SSA_Bin *bin, int reg_dump);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef SSA_OPT_H
+#define SSA_OPT_H
+
+#include "ssa.h"
+
+/* Optimizations over the SSA of a function.  Every pass leaves valid SSA
+ * behind, so any of them can run on the output of the others.  Temporary
+ * data is allocated from scratch and released before returning. */
+
+/* Evaluates arithmetic on constants and turns it, and copies of constants,
+ * into INST_IMM.  Results wrap around at the size of the instruction, and
+ * divisions that would trap at run time are left alone. */
+void ssa_fold_constants(SSA_Fn *fn, MemPool *scratch);
+
+/* Rewrites every use of the result of a copy to the copied register and
+ * removes the copy.  Copies without a result are left for dead code
+ * elimination. */
+void ssa_propagate_copies(SSA_Fn *fn, MemPool *scratch);
+
+/* Gives every value a number from next_vn and replaces instructions that
+ * compute a value that is already in a register, such as repeated
+ * arithmetic on the same operands or an INST_IMM of a constant that was
+ * loaded before. */
+void ssa_number_values(SSA_Fn *fn, MemPool *scratch);
+
+/* Sets pure on every function of prog that has no division that can trap and
+ * only calls pure functions.  Functions that are part of a cycle of calls
+ * might never return, so they are not pure. */
+void ssa_find_pure_fns(SSA_Prog *prog, MemPool *scratch);
+
+/* Removes instructions whose result is never used and that have no other
+ * effect.  Divisions are kept unless their divisor is a constant they can't
+ * trap on, and calls are kept unless the callee is pure. */
+void ssa_eliminate_dead_code(SSA_Fn *fn, MemPool *scratch);
+
+/* Runs every pass over every function on the threads of prog->jobs, each
+ * using its worker pool as scratch */
+void ssa_optimize(SSA_Prog *prog);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdint.h>
+
+#include "ast.h"
+#include "intern.h"
+#include "ssa.h"
+
+/* Compiles a program one function at a time, so that only the tokens and AST
+ * of the function being compiled are kept in memory.  stream_declare_fns
+ * finds every function by matching braces, parses only its signature and
+ * declares it.  stream_compile_fns then lexes, parses, checks and translates
+ * each function on its own and releases its memory before the next one.
+ *
+ * Everything runs on the calling thread, using the first worker and scratch
+ * pools of the AST.  The bodies are gone once they are compiled, so neither
+ * ast_dump nor the cache can be used. */
+
+/* Bytes of a source that make up one function */
+typedef struct {
+  uint32_t file;
+  uint32_t start;
+  uint32_t body; /* just past the '{' opening the body */
+  uint32_t end;
+} StreamFn;
+
+typedef struct {
+  AST *ast;
+  SSA_Prog *prog;
+  Interner *interner;
+  Vector fns; /* StreamFn, in the order of ast->fns */
+} Stream;
+
+/* The files must have been added to ast, which must have no functions yet */
+void stream_declare_fns(Stream *stream, AST *ast, SSA_Prog *prog,
+                        Interner *interner);
+void stream_compile_fns(Stream *stream);
+
+#endif
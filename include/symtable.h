@@ -5,6 +5,7 @@
 #include <stdint.h>
 
 #include "helper.h"
+#include "intern.h"
 #include "type.h"
 
 typedef struct {
@@ -18,24 +19,31 @@ VarInfo make_var_info(int mut, struct Type *type);
 
 typedef struct ScopeEntry {
   SourcePosition pos;
-  struct ScopeEntry *next;
+  Atom atom;
   VarInfo inf;
 } ScopeEntry;
 
+typedef struct {
+  Atom atom; /* 0 if the slot is empty */
+  ScopeEntry *entry;
+} ScopeSlot;
+
+/* open addressing hash table using Robin Hood probing, grows by doubling */
 typedef struct Scope {
   struct Scope *up;
 
-  size_t nbuckets;
-  ScopeEntry **buckets;
+  size_t count;  /* entries in this scope */
+  size_t nslots; /* power of two */
+  ScopeSlot *slots;
 } Scope;
 
 Scope *scope_init(MemPool *pool, Scope *up);
 
 /* returns NULL if already found */
-ScopeEntry *scope_insert(MemPool *pool, Scope *scope, SourcePosition pos,
-                         VarInfo inf);
+ScopeEntry *scope_insert(MemPool *pool, Scope *scope, Atom atom,
+                         SourcePosition pos, VarInfo inf);
 
 /* returns NULL no entry */
-ScopeEntry *scope_find(Scope *scope, SourcePosition pos);
+ScopeEntry *scope_find(Scope *scope, Atom atom);
 
 #endif
@@ -0,0 +1,51 @@
+#ifndef TIME_REPORT_H
+#define TIME_REPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ast.h"
+#include "intern.h"
+#include "ssa.h"
+
+#define TIME_REPORT_MAX_PHASES 16
+
+typedef struct {
+  const char *name;
+  uint64_t wall_ns;
+  uint64_t cpu_ns; /* summed over every thread */
+  /* over the pools of the compile, once the phase is done */
+  size_t committed;
+  size_t used;
+} PhaseTime;
+
+/* Time and memory used by every phase of a compile, for -time-report */
+typedef struct {
+  Interner *interner;
+  AST *ast;
+  SSA_Prog *prog;
+  uint64_t wall_start; /* of the current phase */
+  uint64_t cpu_start;
+  PhaseTime phases[TIME_REPORT_MAX_PHASES];
+  size_t nphases;
+
+  /* time of every function in every phase, indexed by
+   * phase * nfns + function; NULL until time_report_track_fns */
+  uint64_t *fn_times;
+  size_t nfns;
+} TimeReport;
+
+/* Starts the first phase */
+void time_report_init(TimeReport *report, Interner *interner, AST *ast,
+                      SSA_Prog *prog);
+void time_report_deinit(TimeReport *report);
+/* Times every function of the AST from the current phase on, the files of
+ * the AST must be linked */
+void time_report_track_fns(TimeReport *report);
+/* Ends the current phase and starts the next one */
+void time_report_phase(TimeReport *report, const char *name);
+/* Lists the top slowest functions after the phases, if they were tracked */
+void time_report_print(FILE *file, TimeReport *report, size_t top);
+
+#endif
@@ -16,15 +16,77 @@ Type void_const = {.t = TYPE_VOID};
 
 void
 ast_deinit(AST *ast) {
-  mempool_deinit(&ast->pool);
+  job_pool_deinit(&ast->jobs);
+  if (ast->own_pools) {
+    mempool_free_array(ast->own_pools, AST_POOL_COUNT(ast->nworkers));
+  }
+}
+
+void
+ast_init(AST *ast, size_t nworkers) {
+  MemPool *pools = mempool_alloc_array(AST_POOL_COUNT(nworkers));
+  ast_init_pools(ast, pools, nworkers);
+  ast->own_pools = pools;
+}
+
+void
+ast_init_pools(AST *ast, MemPool *pools, size_t nworkers) {
+  ast->pool = &pools[0];
+  ast->nworkers = nworkers;
+  job_pool_init(&ast->jobs, nworkers);
+  ast->worker_pools = &pools[1];
+  ast->scratch_pools = &pools[1 + nworkers];
+  ast->own_pools = NULL;
+  ast_reset(ast);
 }
 
 void
-ast_init(AST *ast, const uint8_t *src) {
-  ast->src_base = src;
-  mempool_init(&ast->pool);
-  ast->global = scope_init(&ast->pool, NULL);
-  vector_init(&ast->fns, sizeof(Function), &ast->pool);
+ast_reset(AST *ast) {
+  mempool_release(ast->pool, 0);
+  for (size_t i = 0; i < ast->nworkers; i++) {
+    mempool_release(&ast->worker_pools[i], 0);
+    mempool_release(&ast->scratch_pools[i], 0);
+  }
+  vector_init(&ast->files, sizeof(SourceFile), ast->pool);
+  ast->global = scope_init(ast->pool, NULL);
+  vector_init(&ast->fns, sizeof(Function), ast->pool);
+}
+
+SourceFile *
+ast_add_file(AST *ast, const char *path, const uint8_t *src, size_t sz) {
+  SourceFile *file = vector_alloc(&ast->files);
+  file->path = path;
+  file->src = src;
+  file->sz = sz;
+  return file;
+}
+
+void
+ast_link_files(AST *ast) {
+  size_t nfns = 0;
+  for (size_t i = 0; i < ast->files.items; i++) {
+    SourceFile *file = vector_idx(&ast->files, i);
+    nfns += file->fns.items;
+  }
+  vector_reserve(&ast->fns, nfns);
+  for (size_t i = 0; i < ast->files.items; i++) {
+    SourceFile *file = vector_idx(&ast->files, i);
+    for (size_t j = 0; j < file->fns.items; j++) {
+      vector_push(&ast->fns, vector_idx(&file->fns, j));
+    }
+  }
+}
+
+const uint8_t *
+ast_src_base(AST *ast, SourcePosition pos) {
+  for (size_t i = 0; i < ast->files.items; i++) {
+    SourceFile *file = vector_idx(&ast->files, i);
+    if (pos.start >= file->src && pos.start < file->src + file->sz) {
+      return file->src;
+    }
+  }
+  log_internal_err("position is not in any source file", NULL);
+  return NULL;
 }
 
 static void
@@ -72,74 +134,93 @@ type_dump(FILE *file, Type *type, int indent) {
   printf("%s\n", type_to_str[type->t]);
 }
 
+typedef struct {
+  ExprId expr;
+  int indent;
+} DumpItem;
+
+/* Nodes are printed before their operands, so they are taken from a stack
+ * of the nodes left to print instead of recursing.  stack has room for every
+ * node of the table. */
 static void
-expr_dump(FILE *file, Expr *expr, int indent) {
-  print_indent(file, indent);
-  switch (expr->t) {
-    case EXPR_INT:
-      fprintf(file, "Expr_Int: %.*s\n", (int)expr->pos.sz,
-              (char *)expr->pos.start);
-      break;
-    case EXPR_VAR:
-      fprintf(file, "Expr_Var: %.*s\n", (int)expr->pos.sz,
-              (char *)expr->pos.start);
-      break;
-    case EXPR_BINOP:
-      fprintf(file, "Expr_Binop: %s\n", str_of_binop(expr->data.binop.op));
-      expr_dump(file, expr->data.binop.left, indent + 1);
-      expr_dump(file, expr->data.binop.right, indent + 1);
-      break;
-    case EXPR_FUNCALL:
-      {
-        fprintf(file, "Expr_Funcall: %.*s\n", (int)expr->data.funcall.name.sz,
-                (char *)expr->data.funcall.name.start);
-        for (size_t i = 0; i < expr->data.funcall.args.items; i++) {
-          Expr *temp_expr = *((Expr **)vector_idx(&expr->data.funcall.args, i));
-          expr_dump(file, temp_expr, indent + 1);
-        }
+expr_dump(FILE *file, ExprTable *exprs, ExprId root, int indent,
+          DumpItem *stack) {
+  size_t top = 0;
+  stack[top++] = (DumpItem){root, indent};
+  while (top > 0) {
+    DumpItem item = stack[--top];
+    ExprId expr = item.expr;
+    print_indent(file, item.indent);
+    SourcePosition pos = expr_pos(exprs, expr);
+    switch (expr_kind(exprs, expr)) {
+      case EXPR_INT:
+        fprintf(file, "Expr_Int: %.*s\n", (int)pos.sz, (char *)pos.start);
         break;
-      }
+      case EXPR_VAR:
+        fprintf(file, "Expr_Var: %.*s\n", (int)pos.sz, (char *)pos.start);
+        break;
+      case EXPR_BINOP:
+        fprintf(file, "Expr_Binop: %s\n", str_of_binop(exprs->subs[expr]));
+        stack[top++] = (DumpItem){exprs->b[expr], item.indent + 1};
+        stack[top++] = (DumpItem){exprs->a[expr], item.indent + 1};
+        break;
+      case EXPR_FUNCALL:
+        {
+          SourcePosition name = expr_call_name(exprs, expr);
+          fprintf(file, "Expr_Funcall: %.*s\n", (int)name.sz,
+                  (char *)name.start);
+          const ExprId *args = expr_call_args(exprs, expr);
+          for (size_t i = expr_call_nargs(exprs, expr); i > 0; i--) {
+            stack[top++] = (DumpItem){args[i - 1], item.indent + 1};
+          }
+          break;
+        }
+    }
   }
 }
 
 static void
-stmt_dump(FILE *file, Stmt *stmt, int indent) {
+stmt_dump(FILE *file, ExprTable *exprs, Stmt *stmt, int indent,
+          DumpItem *stack) {
   print_indent(file, indent);
   switch (stmt->t) {
     case STMT_LET:
       fprintf(file, "Stmt_Let: %.*s\n", (int)stmt->data.let.name.sz,
               (char *)stmt->data.let.name.start);
       type_dump(file, stmt->data.let.type, indent + 1);
-      if (stmt->data.let.value) {
-        expr_dump(file, stmt->data.let.value, indent + 1);
+      if (stmt->data.let.value != EXPR_NONE) {
+        expr_dump(file, exprs, stmt->data.let.value, indent + 1, stack);
       }
       break;
     case STMT_RETURN:
       fprintf(file, "Stmt_Return:\n");
-      if (stmt->data.expr) {
-        expr_dump(file, stmt->data.expr, indent + 1);
+      if (stmt->data.ret != EXPR_NONE) {
+        expr_dump(file, exprs, stmt->data.ret, indent + 1, stack);
       }
       break;
     case STMT_EXPR:
       fprintf(file, "Stmt_Expr:\n");
-      expr_dump(file, stmt->data.expr, indent + 1);
+      expr_dump(file, exprs, stmt->data.expr, indent + 1, stack);
       break;
   }
 }
 
 static void
-fn_dump(FILE *file, Function *fn) {
+fn_dump(FILE *file, Function *fn, MemPool *scratch) {
+  MemPoolMark mark = mempool_mark(scratch);
+  DumpItem *stack = mempool_alloc(scratch, sizeof(DumpItem) * fn->exprs.count);
   fprintf(file, "Fn: ");
   type_dump(file, fn->ret_type, 0);
   for (size_t i = 0; i < fn->body.stmts.items; i++) {
-    stmt_dump(file, vector_idx(&fn->body.stmts, i), 1);
+    stmt_dump(file, &fn->exprs, vector_idx(&fn->body.stmts, i), 1, stack);
   }
+  mempool_release(scratch, mark);
 }
 
 void
 ast_dump(FILE *file, AST *ast) {
   for (size_t i = 0; i < ast->fns.items; i++) {
-    fn_dump(file, vector_idx(&ast->fns, i));
+    fn_dump(file, vector_idx(&ast->fns, i), &ast->scratch_pools[0]);
   }
 }
 
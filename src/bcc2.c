@@ -8,12 +8,15 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include "bcc2.h"
+#include "cache.h"
 #include "helper.h"
-#include "ir_gen.h"
-#include "lexer.h"
-#include "parser.h"
-#include "semantics.h"
+#include "server.h"
 #include "ssa.h"
+#include "ssa_bin.h"
+#include "ssa_opt.h"
+#include "stream.h"
+#include "time_report.h"
 #include "platforms.h"
 
 struct {
@@ -23,7 +26,16 @@ struct {
   int help;
   int version;
   int list_platforms;
-  const char *in_file;
+  int time_report;
+  int stream;
+  int optimize;
+  size_t jobs;
+  const char *cache_dir;
+  const char *emit_ssa_bin;
+  const char *load_ssa_bin;
+  const char *server_socket;
+  size_t in_count;
+  const char **in_files;
   Platform *platform;
 } flags;
 
@@ -31,18 +43,61 @@ void
 parse_args(int argc, char *argv[]) {
   memset(&flags, 0, sizeof(flags));
   flags.platform = &platform_x86_64_sysv;
+  flags.jobs = 1;
+  flags.in_files = malloc(sizeof(char *) * argc);
   for (int i = 1; i < argc; i++) {
     if (argv[i][0] != '-') {
-      if (flags.in_file) {
-        log_err_final("can't specify more than one input file");
-      }
-      flags.in_file = argv[i];
+      flags.in_files[flags.in_count++] = argv[i];
     } else {
       flags.ast_dump |= strcmp(argv[i], "-ast") == 0;
       flags.ir_dump |= strcmp(argv[i], "-ir") == 0;
       flags.reg_dump |= strcmp(argv[i], "-regs") == 0;
       flags.help |= strcmp(argv[i], "-h") == 0;
       flags.version |= strcmp(argv[i], "-v") == 0;
+      flags.time_report |= strcmp(argv[i], "-time-report") == 0;
+      flags.stream |= strcmp(argv[i], "-stream") == 0;
+      flags.optimize |= strcmp(argv[i], "-O") == 0;
+
+      if (strcmp(argv[i], "-j") == 0) {
+        char *end;
+        if (i + 1 >= argc) {
+          log_err_final("expected number of jobs after -j");
+        }
+        long jobs = strtol(argv[i + 1], &end, 10);
+        if (*end != '\0' || jobs < 1 || jobs > 256) {
+          log_err_final("invalid number of jobs '%s'", argv[i + 1]);
+        }
+        flags.jobs = jobs;
+        i++;
+      }
+
+      if (strcmp(argv[i], "-cache") == 0) {
+        if (i + 1 >= argc) {
+          log_err_final("expected directory after -cache");
+        }
+        flags.cache_dir = argv[++i];
+      }
+
+      if (strcmp(argv[i], "-emit-ssa-bin") == 0) {
+        if (i + 1 >= argc) {
+          log_err_final("expected file name after -emit-ssa-bin");
+        }
+        flags.emit_ssa_bin = argv[++i];
+      }
+
+      if (strcmp(argv[i], "-load-ssa-bin") == 0) {
+        if (i + 1 >= argc) {
+          log_err_final("expected file name after -load-ssa-bin");
+        }
+        flags.load_ssa_bin = argv[++i];
+      }
+
+      if (strcmp(argv[i], "-server") == 0) {
+        if (i + 1 >= argc) {
+          log_err_final("expected socket path after -server");
+        }
+        flags.server_socket = argv[++i];
+      }
 
       if (strcmp(argv[i], "-platform") == 0) {
         if (argc == 2) {
@@ -67,6 +122,61 @@ parse_args(int argc, char *argv[]) {
   }
 }
 
+/* number of functions listed by -time-report when compiling in parallel */
+#define TIME_REPORT_TOP 10
+
+static TimeReport time_report;
+
+static void
+phase_done(const char *name) {
+  if (flags.time_report) {
+    time_report_phase(&time_report, name);
+  }
+}
+
+/* runs what only the command line does between the phases of bcc2_compile,
+ * ctx is the FnCache used by -cache */
+static void
+compile_hook(void *ctx, Bcc2Compiler *cc, Bcc2Phase phase) {
+  FnCache *cache = ctx;
+  switch (phase) {
+    case BCC2_PHASE_PARSE:
+      phase_done("lex and parse");
+      if (flags.time_report) {
+        time_report_track_fns(&time_report);
+      }
+      break;
+    case BCC2_PHASE_DECLARE:
+      phase_done("declare");
+      if (flags.cache_dir) {
+        /* the AST dump needs every function to go through the passes */
+        fn_cache_init(cache, flags.cache_dir, flags.platform,
+                      !flags.ast_dump);
+        fn_cache_load(cache, &cc->ast, &cc->prog);
+        phase_done("cache load");
+      }
+      break;
+    case BCC2_PHASE_CHECK:
+      phase_done("check");
+      if (flags.ast_dump) {
+        printf("AST_DUMP:\n");
+        ast_dump(stdout, &cc->ast);
+        printf("\n");
+        phase_done("ast dump");
+      }
+      break;
+    case BCC2_PHASE_TRANSLATE:
+      phase_done("translate");
+      if (flags.cache_dir) {
+        fn_cache_store(cache, &cc->ast, &cc->prog);
+        fprintf(stderr, "cache: %zu hits, %zu misses\n", cache->hits,
+                cache->misses);
+        phase_done("cache store");
+      }
+      break;
+  }
+}
+
 int
 main(int argc, char *argv[]) {
   parse_args(argc, argv);
@@ -77,6 +187,16 @@ main(int argc, char *argv[]) {
            "-ast : dumps ast to stdout\n"
            "-ir : dumps ir to stdout\n"
            "-regs : dumps registers to stdout\n"
+           "-j <n> : parses files and checks and translates functions on n "
+           "threads\n"
+           "-cache <dir> : reuses functions translated by earlier runs\n"
+           "-emit-ssa-bin <file> : writes the ir to file in binary form\n"
+           "-load-ssa-bin <file> : reads the ir from file instead of "
+           "compiling\n"
+           "-server <socket> : serves compile requests on a unix socket\n"
+           "-time-report : prints the time and memory used by each phase\n"
+           "-stream : compiles one function at a time to use less memory\n"
+           "-O : optimizes the ir\n"
            "-platform : list platforms\n"
            "-platform <platform> : selects the platform to compile for\n");
     exit(EXIT_SUCCESS);
@@ -95,54 +215,101 @@ main(int argc, char *argv[]) {
     exit(EXIT_SUCCESS);
   }
 
-  if (!flags.in_file) {
-    log_err_final("no input file specified");
+  if (flags.server_socket) {
+    run_server(flags.server_socket, flags.jobs);
+    exit(EXIT_SUCCESS);
   }
 
   if (!flags.ir_dump && flags.reg_dump) {
     log_err_final("cannot print registers without printing the IR");
   }
 
-  int in_fd = open(flags.in_file, O_RDONLY);
-  if (in_fd == -1) {
-    log_err_final("unable to open '%s'", flags.in_file);
+  if (flags.stream && (flags.ast_dump || flags.cache_dir)) {
+    log_err_final("cannot dump the ast or use the cache with -stream");
   }
 
-  struct stat _in_stat;
-  if (fstat(in_fd, &_in_stat) == -1) {
-    log_err_final("unable to get stats on '%s'", flags.in_file);
+  if (flags.load_ssa_bin) {
+    if (flags.in_count != 0) {
+      log_err_final("cannot compile files when loading the ir");
+    }
+    /* the loaded ir is only mapped and printed, it never becomes an SSA_Prog
+     * that the other flags could work on */
+    if (flags.ast_dump || flags.cache_dir || flags.emit_ssa_bin ||
+        flags.time_report || flags.stream || flags.optimize) {
+      log_err_final("-load-ssa-bin can only be combined with -ir and -regs");
+    }
+    SSA_Bin bin;
+    ssa_bin_load(&bin, flags.load_ssa_bin);
+    if (flags.ir_dump) {
+      printf("IR_DUMP:\n");
+      ssa_bin_dump(stdout, &bin, flags.reg_dump);
+    }
+    ssa_bin_unload(&bin);
+    return EXIT_SUCCESS;
   }
-  size_t in_size = _in_stat.st_size;
 
-  const uint8_t *in_file =
-      mmap(NULL, in_size, PROT_READ, MAP_PRIVATE, in_fd, 0);
-  if (in_file == MAP_FAILED) {
-    log_err_final("unable to get contents of '%s'", flags.in_file);
+  if (flags.in_count == 0) {
+    log_err_final("no input file specified");
   }
 
-  lexer_init(in_file, in_size);
+  Bcc2Compiler cc;
+  bcc2_init(&cc, flags.jobs);
+  FnCache cache;
+  bcc2_set_hook(&cc, compile_hook, &cache);
+  if (flags.time_report) {
+    time_report_init(&time_report, &cc.interner, &cc.ast, &cc.prog);
+  }
 
-  AST ast = parse_ast(in_file);
-  resolve_names(&ast);
-  resolve_types(&ast);
-  check_returns(&ast);
+  Bcc2Source *srcs = malloc(sizeof(Bcc2Source) * flags.in_count);
+  for (size_t i = 0; i < flags.in_count; i++) {
+    srcs[i].path = flags.in_files[i];
+    srcs[i].src = map_file(flags.in_files[i], &srcs[i].sz);
+  }
+  phase_done("map files");
 
-  if (flags.ast_dump) {
-    printf("AST_DUMP:\n");
-    ast_dump(stdout, &ast);
-    printf("\n");
+  SSA_Prog *ssa_prog;
+  if (flags.stream) {
+    for (size_t i = 0; i < flags.in_count; i++) {
+      ast_add_file(&cc.ast, srcs[i].path, srcs[i].src, srcs[i].sz);
+    }
+    Stream stream;
+    stream_declare_fns(&stream, &cc.ast, &cc.prog, &cc.interner);
+    phase_done("declare");
+    stream_compile_fns(&stream);
+    phase_done("compile");
+    ssa_prog = &cc.prog;
+  } else {
+    ssa_prog = bcc2_compile(&cc, srcs, flags.in_count, NULL);
   }
 
-  SSA_Prog ssa_prog;
-  translate_ast(&ast, &ssa_prog);
+  if (flags.optimize) {
+    ssa_optimize(ssa_prog);
+    phase_done("optimize");
+  }
 
   if (flags.ir_dump) {
     printf("IR_DUMP:\n");
-    ssa_prog_dump(stdout, &ssa_prog, flags.reg_dump);
+    ssa_prog_dump(stdout, ssa_prog, flags.reg_dump);
+    phase_done("ir dump");
   }
 
-  ast_deinit(&ast);
+  if (flags.emit_ssa_bin) {
+    ssa_bin_write(flags.emit_ssa_bin, ssa_prog);
+    phase_done("emit ssa bin");
+  }
+
+  if (flags.time_report) {
+    time_report_print(stderr, &time_report,
+                      flags.jobs > 1 ? TIME_REPORT_TOP : 0);
+    time_report_deinit(&time_report);
+  }
+
+  for (size_t i = 0; i < flags.in_count; i++) {
+    munmap((uint8_t *)srcs[i].src, srcs[i].sz);
+  }
+  free(srcs);
+  bcc2_deinit(&cc);
+  free(flags.in_files);
 
-  munmap((uint8_t *)in_file, in_size);
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,497 @@
+#define _GNU_SOURCE
+#include "cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "build_id.h"
+#include "jobs.h"
+
+#define CACHE_MAGIC 0x63326362 /* "bc2c" */
+/* bump whenever the IR or the layout of a cache file changes */
+#define CACHE_VERSION 2
+
+/* Changes to the compiler that forget to bump CACHE_VERSION still must not
+ * reuse entries, so every key also depends on a hash of the sources the
+ * compiler was built from, uncommitted edits included.  Builds of the same
+ * sources share their entries. */
+static const char build_id[] = BCC2_BUILD_ID;
+
+/* A cache file is a header followed by the params, the call arguments, the
+ * instructions, the instruction count of every block and the size of every
+ * register, in that order so that every array stays aligned. */
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  CacheKey key;
+  uint32_t nparams;
+  uint32_t nregs;
+  uint32_t nblocks;
+  uint32_t ninsts; /* over all blocks */
+  uint32_t nargs;  /* call arguments over all instructions */
+  uint32_t pad;
+} CacheHeader;
+
+typedef struct {
+  uint8_t t;
+  uint8_t sz;
+  uint16_t pad;
+  /* callee of INST_CALLFN, as the token naming it relative to tok_start */
+  uint32_t callee;
+  RegId result;
+  /* operands, the immediate, or the first argument and argument count */
+  uint64_t a;
+  uint64_t b;
+} CacheInst;
+
+static size_t
+cache_file_sz(CacheHeader *header) {
+  return sizeof(CacheHeader) + sizeof(RegId) * header->nparams +
+         sizeof(RegId) * header->nargs + sizeof(CacheInst) * header->ninsts +
+         sizeof(uint32_t) * header->nblocks + header->nregs;
+}
+
+void
+fn_cache_init(FnCache *cache, const char *dir, const Platform *platform,
+              int load) {
+  if (mkdir(dir, 0777) == -1 && errno != EEXIST) {
+    log_err_final("unable to create cache directory '%s'", dir);
+  }
+  cache->dir = dir;
+  cache->platform = platform;
+  cache->load = load;
+  cache->keys = NULL;
+  cache->hits = 0;
+  cache->misses = 0;
+}
+
+static void
+key_add(CacheKey *key, const void *data, size_t sz, uint64_t tag) {
+  key->lo = hash_bytes(data, sz, key->lo ^ tag);
+  key->hi = hash_bytes(data, sz, key->hi + tag);
+}
+
+static void
+key_add_type(CacheKey *key, Type *type) {
+  key_add(key, NULL, 0, type->t);
+  if (type->t == TYPE_FN) {
+    key_add_type(key, type->data.fn.ret);
+    key_add(key, NULL, 0, type->data.fn.args.items);
+    for (size_t i = 0; i < type->data.fn.args.items; i++) {
+      key_add_type(key, *(Type **)vector_idx(&type->data.fn.args, i));
+    }
+  }
+}
+
+static CacheKey
+fn_key(FnCache *cache, AST *ast, Function *fn) {
+  CacheKey key = {.lo = CACHE_VERSION, .hi = ~(uint64_t)CACHE_VERSION};
+  key_add(&key, build_id, sizeof(build_id) - 1, 0);
+  key_add(&key, cache->platform->name, strlen(cache->platform->name), 0);
+
+  const TokenBuffer *toks = fn->toks;
+  for (uint32_t i = fn->tok_start; i < fn->tok_end; i++) {
+    SourcePosition pos = token_pos(toks, i);
+    key_add(&key, pos.start, pos.sz,
+            ((uint64_t)toks->kinds[i] << 8) | toks->intlit_types[i]);
+    /* the body depends on the signature of every function it names */
+    if (toks->kinds[i] == TOK_SYM) {
+      ScopeEntry *entry = scope_find(ast->global, toks->atoms[i]);
+      if (entry != NULL) {
+        key_add_type(&key, entry->inf.type);
+      }
+    }
+  }
+  return key;
+}
+
+static char *
+cache_path(FnCache *cache, CacheKey key, MemPool *pool) {
+  size_t sz = strlen(cache->dir) + 34;
+  char *path = mempool_alloc(pool, sz);
+  snprintf(path, sz, "%s/%016" PRIx64 "%016" PRIx64, cache->dir, key.hi,
+           key.lo);
+  return path;
+}
+
+static void *
+read_file(const char *path, size_t *sz, MemPool *pool) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return NULL;
+  }
+  *sz = st.st_size;
+  uint8_t *buf = mempool_alloc_aligned(pool, *sz, 8);
+  for (size_t done = 0; done < *sz;) {
+    ssize_t n = read(fd, buf + done, *sz - done);
+    if (n <= 0) {
+      close(fd);
+      return NULL;
+    }
+    done += n;
+  }
+  close(fd);
+  return buf;
+}
+
+/* registers are numbered from 1, 0 means none */
+static int
+reg_valid(RegId reg, uint32_t nregs) {
+  return reg != 0 && reg <= nregs;
+}
+
+/* checks the fields of an instruction that do not depend on its kind */
+static int
+inst_valid(const CacheInst *cached, uint32_t nregs) {
+  if (cached->t > INST_CALLFN || cached->sz > SZ_64) {
+    return 0;
+  }
+  /* 0 if there is no result or, for an expression statement, it is unused */
+  if (cached->result > (inst_returns_tbl[cached->t] ? nregs : 0)) {
+    return 0;
+  }
+  /* a return without a value has no operand */
+  if (cached->t == INST_RET && cached->sz == SZ_NONE) {
+    return cached->a == 0;
+  }
+  const uint64_t operands[2] = {cached->a, cached->b};
+  for (int i = 0; i < inst_arity_tbl[cached->t]; i++) {
+    if (!reg_valid(operands[i], nregs)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* Rebuilds fn from a cache file, returns 0 if the file does not hold a valid
+ * translation of it */
+static int
+load_fn(AST *ast, Function *fn, SSA_Fn *sem_fn, CacheKey key,
+        const uint8_t *buf, size_t sz, MemPool *pool) {
+  CacheHeader *header = (CacheHeader *)buf;
+  if (sz < sizeof(CacheHeader) || header->magic != CACHE_MAGIC ||
+      header->version != CACHE_VERSION || header->key.lo != key.lo ||
+      header->key.hi != key.hi || header->nblocks == 0 ||
+      cache_file_sz(header) != sz) {
+    return 0;
+  }
+
+  const RegId *params = (const RegId *)(header + 1);
+  const RegId *args = params + header->nparams;
+  const CacheInst *insts = (const CacheInst *)(args + header->nargs);
+  const uint32_t *block_sz = (const uint32_t *)(insts + header->ninsts);
+  const uint8_t *regs = (const uint8_t *)(block_sz + header->nblocks);
+  for (size_t i = 0; i < header->nparams; i++) {
+    if (!reg_valid(params[i], header->nregs)) {
+      return 0;
+    }
+  }
+  for (size_t i = 0; i < header->nargs; i++) {
+    if (!reg_valid(args[i], header->nregs)) {
+      return 0;
+    }
+  }
+  for (size_t i = 0; i < header->nregs; i++) {
+    if (regs[i] > SZ_64) {
+      return 0;
+    }
+  }
+
+  vector_init_size(&sem_fn->params, sizeof(RegId), pool, header->nparams);
+  memcpy(sem_fn->params.data, params, sizeof(RegId) * header->nparams);
+  vector_init_size(&sem_fn->regs, sizeof(SSA_Reg), pool, header->nregs);
+  for (size_t i = 0; i < header->nregs; i++) {
+    ((SSA_Reg *)vector_idx(&sem_fn->regs, i))->sz = regs[i];
+  }
+
+  SSA_BBlock **link = &sem_fn->entry;
+  size_t next_inst = 0;
+  for (size_t b = 0; b < header->nblocks; b++) {
+    if (block_sz[b] > header->ninsts - next_inst) {
+      return 0;
+    }
+    SSA_BBlock *block = mempool_alloc(pool, sizeof(SSA_BBlock));
+    vector_init_size(&block->insts, sizeof(SSA_Inst), pool, block_sz[b]);
+    block->next = NULL;
+    *link = block;
+    link = &block->next;
+
+    for (size_t i = 0; i < block_sz[b]; i++) {
+      const CacheInst *cached = &insts[next_inst++];
+      SSA_Inst *inst = vector_idx(&block->insts, i);
+      if (!inst_valid(cached, header->nregs)) {
+        return 0;
+      }
+      inst->t = cached->t;
+      inst->sz = cached->sz;
+      inst->result = cached->result;
+      switch (inst->t) {
+        case INST_IMM:
+          inst->data.imm = cached->a;
+          break;
+        case INST_CALLFN:
+          {
+            uint32_t tok = fn->tok_start + cached->callee;
+            if (cached->callee >= fn->tok_end - fn->tok_start ||
+                fn->toks->kinds[tok] != TOK_SYM || cached->a > header->nargs ||
+                cached->b > header->nargs - cached->a) {
+              return 0;
+            }
+            ScopeEntry *entry = scope_find(ast->global, fn->toks->atoms[tok]);
+            if (entry == NULL) {
+              return 0;
+            }
+            inst->data.callfn.fn = entry->inf.fn;
+            vector_init_size(&inst->data.callfn.args, sizeof(RegId), pool,
+                             cached->b);
+            memcpy(inst->data.callfn.args.data, args + cached->a,
+                   sizeof(RegId) * cached->b);
+          }
+          break;
+        default:
+          inst->data.operands[0] = cached->a;
+          inst->data.operands[1] = cached->b;
+          break;
+      }
+    }
+  }
+  sem_fn->name = fn->name;
+  return 1;
+}
+
+typedef struct {
+  FnCache *cache;
+  AST *ast;
+  SSA_Prog *prog;
+} CacheJob;
+
+static void
+load_fn_job(void *ctx, size_t idx, size_t worker) {
+  CacheJob *job = ctx;
+  FnCache *cache = job->cache;
+  Function *fn = vector_idx(&job->ast->fns, idx);
+  /* file contents only live until the function is rebuilt */
+  MemPool *scratch = &job->ast->worker_pools[worker];
+  MemPoolMark mark = mempool_mark(scratch);
+
+  cache->keys[idx] = fn_key(cache, job->ast, fn);
+  if (cache->load) {
+    size_t sz;
+    const uint8_t *buf =
+        read_file(cache_path(cache, cache->keys[idx], scratch), &sz, scratch);
+    if (buf != NULL &&
+        load_fn(job->ast, fn, vector_idx(&job->prog->fns, idx),
+                cache->keys[idx], buf, sz, &job->prog->worker_pools[worker])) {
+      fn->cached = 1;
+    }
+  }
+  mempool_release(scratch, mark);
+  __atomic_fetch_add(fn->cached ? &cache->hits : &cache->misses, 1,
+                     __ATOMIC_RELAXED);
+}
+
+void
+fn_cache_load(FnCache *cache, AST *ast, SSA_Prog *prog) {
+  cache->keys = mempool_alloc(ast->pool, sizeof(CacheKey) * ast->fns.items);
+  CacheJob job = {.cache = cache, .ast = ast, .prog = prog};
+  parallel_for(&ast->jobs, ast->fns.items, load_fn_job, &job);
+}
+
+/* first token naming every symbol of a function, relative to tok_start */
+typedef struct {
+  Atom atom; /* 0 if the slot is empty */
+  uint32_t tok;
+} SymSlot;
+
+/* open addressing hash table using linear probing, built once per function
+ * so that finding the callee of a call does not scan the tokens */
+typedef struct {
+  size_t mask;
+  SymSlot *slots; /* NULL until the first call needs it */
+} SymToks;
+
+static void
+sym_toks_init(SymToks *syms, Function *fn, MemPool *pool) {
+  /* every symbol is a token, so the table stays at most half full */
+  size_t nslots = 8;
+  while (nslots < 2 * (size_t)(fn->tok_end - fn->tok_start)) {
+    nslots *= 2;
+  }
+  syms->mask = nslots - 1;
+  syms->slots = mempool_alloc(pool, sizeof(SymSlot) * nslots);
+  memset(syms->slots, 0, sizeof(SymSlot) * nslots);
+
+  for (uint32_t i = fn->tok_start; i < fn->tok_end; i++) {
+    if (fn->toks->kinds[i] != TOK_SYM) {
+      continue;
+    }
+    Atom atom = fn->toks->atoms[i];
+    size_t slot = atom_hash(atom) & syms->mask;
+    while (syms->slots[slot].atom != 0 && syms->slots[slot].atom != atom) {
+      slot = (slot + 1) & syms->mask;
+    }
+    if (syms->slots[slot].atom == 0) {
+      syms->slots[slot].atom = atom;
+      syms->slots[slot].tok = i - fn->tok_start;
+    }
+  }
+}
+
+/* returns the token naming callee inside fn, relative to tok_start */
+static int
+find_callee_tok(AST *ast, SSA_Prog *prog, Function *fn, SymToks *syms,
+                SSA_Fn *callee, uint32_t *tok, MemPool *pool) {
+  if (syms->slots == NULL) {
+    sym_toks_init(syms, fn, pool);
+  }
+  Atom atom =
+      ((Function *)vector_idx(&ast->fns, callee - (SSA_Fn *)prog->fns.data))
+          ->atom;
+  for (size_t slot = atom_hash(atom) & syms->mask; syms->slots[slot].atom != 0;
+       slot = (slot + 1) & syms->mask) {
+    if (syms->slots[slot].atom == atom) {
+      *tok = syms->slots[slot].tok;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Lays out fn as a cache file, returns NULL if it cannot be cached */
+static uint8_t *
+build_file(AST *ast, SSA_Prog *prog, Function *fn, SSA_Fn *sem_fn,
+           CacheKey key, size_t *sz, MemPool *pool) {
+  CacheHeader header = {.magic = CACHE_MAGIC,
+                        .version = CACHE_VERSION,
+                        .key = key,
+                        .nparams = sem_fn->params.items,
+                        .nregs = sem_fn->regs.items};
+  for (SSA_BBlock *block = sem_fn->entry; block; block = block->next) {
+    header.nblocks++;
+    header.ninsts += block->insts.items;
+    for (size_t i = 0; i < block->insts.items; i++) {
+      SSA_Inst *inst = vector_idx(&block->insts, i);
+      if (inst->t == INST_CALLFN) {
+        header.nargs += inst->data.callfn.args.items;
+      }
+    }
+  }
+
+  *sz = cache_file_sz(&header);
+  uint8_t *buf = mempool_alloc_aligned(pool, *sz, 8);
+  memcpy(buf, &header, sizeof(CacheHeader));
+  RegId *params = (RegId *)(buf + sizeof(CacheHeader));
+  RegId *args = params + header.nparams;
+  CacheInst *insts = (CacheInst *)(args + header.nargs);
+  uint32_t *block_sz = (uint32_t *)(insts + header.ninsts);
+  uint8_t *regs = (uint8_t *)(block_sz + header.nblocks);
+
+  memcpy(params, sem_fn->params.data, sizeof(RegId) * header.nparams);
+  for (size_t i = 0; i < header.nregs; i++) {
+    regs[i] = ((SSA_Reg *)vector_idx(&sem_fn->regs, i))->sz;
+  }
+
+  SymToks syms = {.slots = NULL};
+  size_t next_arg = 0;
+  for (SSA_BBlock *block = sem_fn->entry; block; block = block->next) {
+    *block_sz++ = block->insts.items;
+    for (size_t i = 0; i < block->insts.items; i++) {
+      SSA_Inst *inst = vector_idx(&block->insts, i);
+      CacheInst *cached = insts++;
+      memset(cached, 0, sizeof(CacheInst));
+      cached->t = inst->t;
+      cached->sz = inst->sz;
+      cached->result = inst->result;
+      switch (inst->t) {
+        case INST_IMM:
+          cached->a = inst->data.imm;
+          break;
+        case INST_CALLFN:
+          if (!find_callee_tok(ast, prog, fn, &syms, inst->data.callfn.fn,
+                               &cached->callee, pool)) {
+            return NULL;
+          }
+          cached->a = next_arg;
+          cached->b = inst->data.callfn.args.items;
+          memcpy(args + next_arg, inst->data.callfn.args.data,
+                 sizeof(RegId) * cached->b);
+          next_arg += cached->b;
+          break;
+        default:
+          cached->a = inst->data.operands[0];
+          cached->b = inst->data.operands[1];
+          break;
+      }
+    }
+  }
+  return buf;
+}
+
+/* writes to a temporary file first, so that concurrent compiles never see a
+ * partial file */
+static void
+write_file(const char *path, const uint8_t *buf, size_t sz, size_t worker,
+           MemPool *pool) {
+  size_t tmp_sz = strlen(path) + 48;
+  char *tmp = mempool_alloc(pool, tmp_sz);
+  snprintf(tmp, tmp_sz, "%s.%ld.%zu.tmp", path, (long)getpid(), worker);
+
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd == -1) {
+    log_err("unable to write cache file '%s'", tmp);
+    return;
+  }
+  for (size_t done = 0; done < sz;) {
+    ssize_t n = write(fd, buf + done, sz - done);
+    if (n <= 0) {
+      log_err("unable to write cache file '%s'", tmp);
+      close(fd);
+      unlink(tmp);
+      return;
+    }
+    done += n;
+  }
+  close(fd);
+  if (rename(tmp, path) == -1) {
+    log_err("unable to write cache file '%s'", path);
+    unlink(tmp);
+  }
+}
+
+static void
+store_fn_job(void *ctx, size_t idx, size_t worker) {
+  CacheJob *job = ctx;
+  Function *fn = vector_idx(&job->ast->fns, idx);
+  if (fn->cached) {
+    return;
+  }
+
+  MemPool *scratch = &job->ast->worker_pools[worker];
+  MemPoolMark mark = mempool_mark(scratch);
+  size_t sz;
+  uint8_t *buf =
+      build_file(job->ast, job->prog, fn, vector_idx(&job->prog->fns, idx),
+                 job->cache->keys[idx], &sz, scratch);
+  if (buf != NULL) {
+    write_file(cache_path(job->cache, job->cache->keys[idx], scratch), buf,
+               sz, worker, scratch);
+  }
+  mempool_release(scratch, mark);
+}
+
+void
+fn_cache_store(FnCache *cache, AST *ast, SSA_Prog *prog) {
+  CacheJob job = {.cache = cache, .ast = ast, .prog = prog};
+  parallel_for(&ast->jobs, ast->fns.items, store_fn_job, &job);
+}
@@ -0,0 +1,124 @@
+#include "bcc2.h"
+
+#include <setjmp.h>
+
+#include "ir_gen.h"
+#include "jobs.h"
+#include "lexer.h"
+#include "parser.h"
+#include "semantics.h"
+
+void
+bcc2_init(Bcc2Compiler *cc, size_t nworkers) {
+  size_t npools = bcc2_pool_count(nworkers);
+  MemPool *pools = mempool_alloc_array(npools);
+  bcc2_init_pools(cc, pools, nworkers);
+  cc->own_pools = pools;
+}
+
+size_t
+bcc2_pool_count(size_t nworkers) {
+  /* the interner, then the pools of the AST and of the program */
+  return 1 + AST_POOL_COUNT(nworkers) + 1 + nworkers;
+}
+
+void
+bcc2_init_pools(Bcc2Compiler *cc, MemPool *pools, size_t nworkers) {
+  interner_init_pool(&cc->interner, &pools[0]);
+  ast_init_pools(&cc->ast, &pools[1], nworkers);
+  ssa_prog_init_pools(&cc->prog, &pools[1 + AST_POOL_COUNT(nworkers)],
+                      nworkers);
+  cc->own_pools = NULL;
+  cc->hook = NULL;
+  cc->hook_ctx = NULL;
+}
+
+void
+bcc2_deinit(Bcc2Compiler *cc) {
+  ssa_prog_deinit(&cc->prog);
+  ast_deinit(&cc->ast);
+  interner_deinit(&cc->interner);
+  if (cc->own_pools != NULL) {
+    mempool_free_array(cc->own_pools, bcc2_pool_count(cc->ast.nworkers));
+  }
+}
+
+void
+bcc2_set_hook(Bcc2Compiler *cc, Bcc2Hook hook, void *ctx) {
+  cc->hook = hook;
+  cc->hook_ctx = ctx;
+}
+
+static void
+parse_job(void *ctx, size_t idx, size_t worker) {
+  Bcc2Compiler *cc = ctx;
+  SourceFile *file = vector_idx(&cc->ast.files, idx);
+  MemPool *pool = &cc->ast.worker_pools[worker];
+
+  Lexer lex;
+  lexer_init(&lex, file->src, file->sz, &cc->interner);
+  lexer_tokenize(&lex, &file->tokens, pool);
+
+  Parser parser;
+  parser_init(&parser, file, pool, &cc->ast.scratch_pools[worker]);
+  parse_ast(&parser);
+}
+
+static void
+run_hook(Bcc2Compiler *cc, Bcc2Phase phase) {
+  if (cc->hook != NULL) {
+    cc->hook(cc->hook_ctx, cc, phase);
+  }
+}
+
+/* returns 0 and fills sink on the first error, errors exit if sink is NULL */
+static int
+run_passes(Bcc2Compiler *cc, DiagSink *sink) {
+  DiagSink *prev = diag_sink_get();
+  if (sink != NULL) {
+    diag_sink_set(sink);
+    if (setjmp(sink->env) != 0) {
+      diag_sink_set(prev);
+      return 0;
+    }
+  }
+
+  parallel_for(&cc->ast.jobs, cc->ast.files.items, parse_job, cc);
+  ast_link_files(&cc->ast);
+  run_hook(cc, BCC2_PHASE_PARSE);
+  declare_fns(&cc->ast);
+  ssa_prog_declare_fns(&cc->prog, &cc->ast);
+  run_hook(cc, BCC2_PHASE_DECLARE);
+  check_fns(&cc->ast);
+  run_hook(cc, BCC2_PHASE_CHECK);
+  translate_ast(&cc->ast, &cc->prog);
+  run_hook(cc, BCC2_PHASE_TRANSLATE);
+
+  diag_sink_set(prev);
+  return 1;
+}
+
+SSA_Prog *
+bcc2_compile(Bcc2Compiler *cc, const Bcc2Source *srcs, size_t nsrcs,
+             Diagnostic *diag) {
+  interner_reset(&cc->interner);
+  ast_reset(&cc->ast);
+  ssa_prog_reset(&cc->prog);
+
+  for (size_t i = 0; i < nsrcs; i++) {
+    ast_add_file(&cc->ast, srcs[i].path, srcs[i].src, srcs[i].sz);
+  }
+
+  DiagSink sink;
+  if (run_passes(cc, diag != NULL ? &sink : NULL)) {
+    return &cc->prog;
+  }
+
+  *diag = sink.diag;
+  for (size_t i = 0; i < nsrcs && diag->src != NULL; i++) {
+    if (srcs[i].src == diag->src) {
+      diag->path = srcs[i].path;
+    }
+  }
+  return NULL;
+}
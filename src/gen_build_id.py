@@ -0,0 +1,58 @@
+#!/usr/bin/env python3
+"""Writes build_id.h, which identifies the compiler by a hash of its sources.
+
+The cache keys its entries on the hash, so that a compiler built from
+different sources, committed or not, never reuses them.  The header is only
+rewritten when the hash changes, so that files including it are not rebuilt
+for nothing.
+
+    gen_build_id.py <source root> <output>
+"""
+
+import hashlib
+import os
+import sys
+
+DIRS = ("include", "src")
+EXTS = (".c", ".h")
+
+
+def source_files(root):
+    for top in DIRS:
+        for dirpath, dirnames, filenames in os.walk(os.path.join(root, top)):
+            dirnames.sort()
+            for name in sorted(filenames):
+                if name.endswith(EXTS):
+                    yield os.path.join(dirpath, name)
+
+
+def main():
+    root, output = sys.argv[1:]
+    digest = hashlib.sha256()
+    for path in source_files(root):
+        rel = os.path.relpath(path, root).replace(os.sep, "/")
+        with open(path, "rb") as f:
+            data = f.read()
+        digest.update(b"%s\0%d\0" % (rel.encode(), len(data)))
+        digest.update(data)
+
+    header = ("#ifndef BCC2_BUILD_ID_H\n"
+              "#define BCC2_BUILD_ID_H\n"
+              "\n"
+              "/* hash of the sources the compiler was built from */\n"
+              "#define BCC2_BUILD_ID \"%s\"\n"
+              "\n"
+              "#endif\n" % digest.hexdigest()[:32])
+    try:
+        with open(output) as f:
+            if f.read() == header:
+                return 0
+    except OSError:
+        pass
+    with open(output, "w") as f:
+        f.write(header)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
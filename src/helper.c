@@ -1,19 +1,28 @@
 #define _GNU_SOURCE
 #include "helper.h"
 
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 #define RED "\033[0;31m"
 #define BLUE "\033[0;34m"
 #define WHITE_UNDERLINE "\033[1;37m"
 #define RESET "\033[0m"
 
-#define POOL_MAX_SZ 4294967296
+/* address space reserved by mempool_init, only committed pages use memory */
+#define POOL_DEFAULT_RESERVE ((size_t)4 << 30)
 #define POOL_CHUNK_SZ 4096
+/* pools are aligned to this, and advised to use transparent huge pages once
+ * they grow past it */
+#define POOL_HUGE_SZ ((size_t)2 << 20)
 
 SourcePosition
 combine_pos(SourcePosition pos1, SourcePosition pos2) {
@@ -29,25 +38,161 @@ make_pos(const uint8_t *buf, size_t sz) {
   return ret;
 }
 
+static inline uint64_t
+rotl64(uint64_t x, int n) {
+  return (x << n) | (x >> (64 - n));
+}
+
+/* FxHash style word-at-a-time mixing, followed by the murmur3 finalizer so
+ * that the low bits used for table indices depend on every input byte */
+uint64_t
+hash_bytes(const uint8_t *data, size_t sz, uint64_t seed) {
+  const uint64_t k = 0x517cc1b727220a95;
+  uint64_t h = seed ^ (sz * 0x9e3779b97f4a7c15);
+  for (; sz >= 8; data += 8, sz -= 8) {
+    uint64_t word;
+    memcpy(&word, data, 8);
+    h = (rotl64(h, 5) ^ word) * k;
+  }
+  if (sz > 0) {
+    uint64_t word = 0;
+    memcpy(&word, data, sz);
+    h = (rotl64(h, 5) ^ word) * k;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccd;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53;
+  h ^= h >> 33;
+  return h;
+}
+
 int64_t
-next_vn() {
-  static int64_t reg = 1;
-  return reg++;
+next_vn(int64_t *counter) {
+  return ++(*counter);
+}
+
+static pthread_key_t sink_key;
+static pthread_once_t sink_once = PTHREAD_ONCE_INIT;
+
+static void
+make_sink_key(void) {
+  pthread_key_create(&sink_key, NULL);
+}
+
+DiagSink *
+diag_sink_set(DiagSink *sink) {
+  DiagSink *prev = diag_sink_get();
+  pthread_setspecific(sink_key, sink);
+  return prev;
+}
+
+DiagSink *
+diag_sink_get(void) {
+  pthread_once(&sink_once, make_sink_key);
+  return pthread_getspecific(sink_key);
+}
+
+void
+diag_rethrow(const Diagnostic *diag) {
+  DiagSink *sink = diag_sink_get();
+  if (sink == NULL) {
+    log_internal_err("rethrown error without a sink: %s", diag->msg);
+  }
+  sink->diag = *diag;
+  longjmp(sink->env, 1);
+}
+
+void
+diag_report_final(const Diagnostic *diag) {
+  flockfile(stderr);
+  if (diag->kind == DIAG_INTERNAL) {
+    fprintf(stderr, BLUE "internal error: " RESET "%s:%zd: %s\n", diag->file,
+            diag->file_line, diag->msg);
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(stderr, RED "error" RESET ": %s\n", diag->msg);
+  if (diag->src != NULL) {
+    /* the same line log_source_err underlines */
+    const uint8_t *p = diag->src;
+    for (size_t line = 1; line < diag->line; p++) {
+      if (*p == '\n') {
+        line++;
+      }
+    }
+    fprintf(stderr, " | " WHITE_UNDERLINE);
+    for (; *p != '\n'; p++) {
+      putc(*p, stderr);
+    }
+    fprintf(stderr, RESET "\n");
+  }
+  exit(EXIT_FAILURE);
+}
+
+uint64_t
+wall_time_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t
+cpu_time_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Hands the error to the sink of this thread, if there is one */
+static void
+diag_raise(DiagKind kind, const uint8_t *base, const SourcePosition *pos,
+           const char *file, size_t file_line, const char *fmt,
+           va_list args) {
+  DiagSink *sink = diag_sink_get();
+  if (sink == NULL) {
+    return;
+  }
+  Diagnostic *diag = &sink->diag;
+  diag->kind = kind;
+  diag->src = base;
+  diag->path = NULL;
+  diag->line = 0;
+  diag->column = 0;
+  diag->file = file;
+  diag->file_line = file_line;
+  if (pos != NULL) {
+    const uint8_t *line_start = base;
+    diag->line = 1;
+    for (const uint8_t *p = base; p < pos->start; p++) {
+      if (*p == '\n') {
+        diag->line++;
+        line_start = p + 1;
+      }
+    }
+    diag->column = pos->start - line_start + 1;
+  }
+  vsnprintf(diag->msg, sizeof(diag->msg), fmt, args);
+  longjmp(sink->env, 1);
 }
 
 void
 log_err(const char *fmt, ...) {
   va_list args;
   va_start(args, fmt);
+  flockfile(stderr);
   fprintf(stderr, RED "error" RESET ": ");
   vfprintf(stderr, fmt, args);
   fprintf(stderr, "\n");
+  funlockfile(stderr);
 }
 
 void
 log_err_final(const char *fmt, ...) {
   va_list args;
   va_start(args, fmt);
+  diag_raise(DIAG_ERROR, NULL, NULL, NULL, 0, fmt, args);
+  flockfile(stderr);
   fprintf(stderr, RED "error" RESET ": ");
   vfprintf(stderr, fmt, args);
   fprintf(stderr, "\n");
@@ -58,6 +203,10 @@ void
 actual_log_internal_err(const char *fmt, const char *file, size_t line, ...) {
   va_list args;
   va_start(args, line);
+  diag_raise(DIAG_INTERNAL, NULL, NULL, file, line, fmt, args);
+  /* the lock is never released, so a worker thread that errors at the same
+   * time cannot interleave its message with this one */
+  flockfile(stderr);
   fprintf(stderr, BLUE "internal error: " RESET "%s:%zd: ", file, line);
   vfprintf(stderr, fmt, args);
   fprintf(stderr, "\n");
@@ -68,7 +217,9 @@ void
 log_source_err(const char *fmt, const uint8_t *base, SourcePosition pos, ...) {
   va_list args;
   va_start(args, pos);
+  diag_raise(DIAG_ERROR, base, &pos, NULL, 0, fmt, args);
 
+  flockfile(stderr);
   fprintf(stderr, RED "error" RESET ": ");
   vfprintf(stderr, fmt, args);
   fprintf(stderr, "\n");
@@ -85,62 +236,186 @@ log_source_err(const char *fmt, const uint8_t *base, SourcePosition pos, ...) {
   exit(EXIT_FAILURE);
 }
 
+const uint8_t *
+map_file(const char *path, size_t *size) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    log_err_final("unable to open '%s'", path);
+  }
+
+  struct stat _stat;
+  if (fstat(fd, &_stat) == -1) {
+    close(fd);
+    log_err_final("unable to get stats on '%s'", path);
+  }
+  *size = _stat.st_size;
+
+  const uint8_t *buf = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (buf == MAP_FAILED) {
+    log_err_final("unable to get contents of '%s'", path);
+  }
+  return buf;
+}
+
+static inline size_t
+round_up(size_t n, size_t align) {
+  return (n + align - 1) & ~(align - 1);
+}
+
 void
-mempool_init(MemPool *pool) {
-  pool->base =
-      mmap(NULL, POOL_MAX_SZ, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-  if (pool->base == MAP_FAILED) {
+mempool_init_reserve(MemPool *pool, size_t reserve) {
+  reserve = round_up(reserve, POOL_HUGE_SZ);
+
+  /* over-reserve so the base can be aligned for huge pages */
+  size_t map_sz = reserve + POOL_HUGE_SZ;
+  uint8_t *map = mmap(NULL, map_sz, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (map == MAP_FAILED) {
     log_internal_err("unable to open mmap pool", NULL);
   }
-  if (mprotect(pool->base, POOL_CHUNK_SZ, PROT_READ | PROT_WRITE) == -1) {
-    log_internal_err("unable to block out memory in pool", NULL);
+  uint8_t *base = (uint8_t *)round_up((uintptr_t)map, POOL_HUGE_SZ);
+  if (base != map) {
+    munmap(map, base - map);
+  }
+  if (map + map_sz != base + reserve) {
+    munmap(base + reserve, (map + map_sz) - (base + reserve));
   }
+
+  pool->base = base;
+  pool->reserved = reserve;
+  pool->alloc = 0;
   pool->size = 0;
-  pool->alloc = POOL_CHUNK_SZ;
+  pool->high_water = 0;
+}
+
+void
+mempool_init(MemPool *pool) {
+  mempool_init_reserve(pool, POOL_DEFAULT_RESERVE);
 }
 
 void
 mempool_deinit(MemPool *pool) {
-  if (munmap(pool->base, POOL_MAX_SZ) == -1) {
+  if (munmap(pool->base, pool->reserved) == -1) {
     log_internal_err("unable to close memory pool", NULL);
   }
   pool->base = NULL;
 }
 
-static inline size_t
-size_needed(size_t requested) {
-  size_t ret = 0;
-  while (ret < requested) {
-    ret += POOL_CHUNK_SZ;
+/* Commits at least up to needed bytes.  The committed size at least doubles
+ * each time, so a pool of n bytes only takes O(log n) mprotect calls. */
+static void
+mempool_commit(MemPool *pool, size_t needed) {
+  if (needed > pool->reserved) {
+    log_internal_err("out of memory in mmap pool", NULL);
   }
-  return ret;
+  size_t new_alloc = pool->alloc * 2;
+  if (new_alloc < needed) {
+    new_alloc = round_up(needed, POOL_CHUNK_SZ);
+  }
+  if (new_alloc > pool->reserved) {
+    new_alloc = pool->reserved;
+  }
+
+  if (mprotect(pool->base + pool->alloc, new_alloc - pool->alloc,
+               PROT_READ | PROT_WRITE) == -1) {
+    log_internal_err("unable to block out memory in pool", NULL);
+  }
+#ifdef MADV_HUGEPAGE
+  if (pool->alloc < POOL_HUGE_SZ && new_alloc >= POOL_HUGE_SZ) {
+    /* only a hint, failure just means no huge pages */
+    madvise(pool->base, pool->reserved, MADV_HUGEPAGE);
+  }
+#endif
+  pool->alloc = new_alloc;
+}
+
+void *
+mempool_alloc_aligned(MemPool *pool, size_t amount, size_t align) {
+  size_t start = round_up(pool->size, align);
+  size_t end = start + amount;
+  if (end > pool->alloc) {
+    mempool_commit(pool, end);
+  }
+  pool->size = end;
+  if (end > pool->high_water) {
+    pool->high_water = end;
+  }
+  return pool->base + start;
 }
 
 void *
 mempool_alloc(MemPool *pool, size_t amount) {
-  if (pool->size + amount + 1 >= pool->alloc) {
-    size_t needed = size_needed(amount);
-    if (pool->alloc + needed > POOL_MAX_SZ) {
-      log_internal_err("out of memory in mmap pool", NULL);
-    }
-    mprotect(pool->base + pool->alloc, needed, PROT_READ | PROT_WRITE);
-    pool->alloc += needed;
+  return mempool_alloc_aligned(pool, amount, POOL_ALIGN);
+}
+
+int
+mempool_resize_last(MemPool *pool, void *ptr, size_t old_sz, size_t new_sz) {
+  if ((uint8_t *)ptr + old_sz != pool->base + pool->size) {
+    return 0;
   }
-  void *ret = pool->base + pool->size;
-  pool->size += amount;
-  return ret;
+  size_t end = ((uint8_t *)ptr - pool->base) + new_sz;
+  if (end > pool->alloc) {
+    mempool_commit(pool, end);
+  }
+  pool->size = end;
+  if (end > pool->high_water) {
+    pool->high_water = end;
+  }
+  return 1;
+}
+
+MemPoolMark
+mempool_mark(MemPool *pool) {
+  return pool->size;
+}
+
+void
+mempool_release(MemPool *pool, MemPoolMark mark) {
+  if (mark > pool->size) {
+    log_internal_err("released pool mark %zu is past the end of the pool",
+                     mark);
+  }
+  pool->size = mark;
 }
 
-/* start this high, so that we don't have to copy too many times */
-#define VEC_INIT_ALLOC 32
+MemPoolStats
+mempool_stats(MemPool *pool) {
+  MemPoolStats stats = {.reserved = pool->reserved,
+                        .committed = pool->alloc,
+                        .used = pool->size,
+                        .high_water = pool->high_water};
+  return stats;
+}
+
+MemPool *
+mempool_alloc_array(size_t n) {
+  MemPool *pools = malloc(sizeof(MemPool) * n);
+  for (size_t i = 0; i < n; i++) {
+    mempool_init(&pools[i]);
+  }
+  return pools;
+}
+
+void
+mempool_free_array(MemPool *pools, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    mempool_deinit(&pools[i]);
+  }
+  free(pools);
+}
+
+/* Vectors allocate nothing until the first push and then start small, most
+ * vectors (call arguments, parameters) only ever hold a few items */
+#define VEC_MIN_ALLOC 4
 
 void
 vector_init(Vector *vec, size_t it_sz, MemPool *pool) {
   vec->it_sz = it_sz;
   vec->items = 0;
-  vec->alloc = VEC_INIT_ALLOC;
+  vec->alloc = 0;
   vec->pool = pool;
-  vec->data = mempool_alloc(pool, it_sz * VEC_INIT_ALLOC);
+  vec->data = NULL;
 }
 
 void
@@ -152,13 +427,45 @@ vector_init_size(Vector *vec, size_t it_sz, MemPool *pool, size_t items) {
   vec->data = mempool_alloc(pool, it_sz * vec->alloc);
 }
 
-void
-vector_resize(Vector *vec) {
-  uint8_t *new_data = mempool_alloc(vec->pool, vec->alloc * vec->it_sz * 2);
-  memcpy(new_data, vec->data, vec->items * vec->it_sz);
+static void
+vector_grow_to(Vector *vec, size_t alloc) {
+  /* a vector that was the last allocation in its pool grows in place instead
+   * of leaving its old buffer behind */
+  if (vec->data != NULL &&
+      mempool_resize_last(vec->pool, vec->data, vec->alloc * vec->it_sz,
+                          alloc * vec->it_sz)) {
+    vec->alloc = alloc;
+    return;
+  }
+  uint8_t *new_data = mempool_alloc(vec->pool, alloc * vec->it_sz);
+  if (vec->items > 0) {
+    memcpy(new_data, vec->data, vec->items * vec->it_sz);
+  }
   vec->data = new_data;
-  vec->alloc *= 2;
+  vec->alloc = alloc;
 }
+
+static void
+vector_resize(Vector *vec) {
+  vector_grow_to(vec, vec->alloc ? vec->alloc * 2 : VEC_MIN_ALLOC);
+}
+
+void
+vector_reserve(Vector *vec, size_t items) {
+  if (items > vec->alloc) {
+    vector_grow_to(vec, items);
+  }
+}
+
+void
+vector_freeze(Vector *vec) {
+  if (vec->data != NULL &&
+      mempool_resize_last(vec->pool, vec->data, vec->alloc * vec->it_sz,
+                          vec->items * vec->it_sz)) {
+    vec->alloc = vec->items;
+  }
+}
+
 void
 vector_push(Vector *vec, void *data) {
   if (vec->items + 1 > vec->alloc) {
@@ -170,7 +477,7 @@ vector_push(Vector *vec, void *data) {
 void
 vector_remove(Vector *vec, size_t idx) {
   memmove(vec->data + idx * vec->it_sz, vec->data + (idx + 1) * vec->it_sz,
-          (vec->items - idx) * vec->it_sz);
+          (vec->items - idx - 1) * vec->it_sz);
   vec->items--;
 }
 
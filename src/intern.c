@@ -0,0 +1,127 @@
+#include "intern.h"
+
+#include <string.h>
+
+/* per shard, must be a power of two */
+#define INIT_SLOTS 64
+
+static InternSlot *
+alloc_slots(Interner *interner, size_t nslots) {
+  pthread_mutex_lock(&interner->pool_lock);
+  InternSlot *slots =
+      mempool_alloc(interner->pool, sizeof(InternSlot) * nslots);
+  pthread_mutex_unlock(&interner->pool_lock);
+  memset(slots, 0, sizeof(InternSlot) * nslots);
+  return slots;
+}
+
+void
+interner_init(Interner *interner) {
+  mempool_init(&interner->own_pool);
+  interner_init_pool(interner, &interner->own_pool);
+  interner->owns_pool = 1;
+}
+
+void
+interner_init_pool(Interner *interner, MemPool *pool) {
+  pthread_mutex_init(&interner->pool_lock, NULL);
+  interner->pool = pool;
+  interner->owns_pool = 0;
+  for (size_t i = 0; i < INTERN_SHARDS; i++) {
+    pthread_mutex_init(&interner->shards[i].lock, NULL);
+  }
+  interner_reset(interner);
+}
+
+void
+interner_reset(Interner *interner) {
+  mempool_release(interner->pool, 0);
+  for (size_t i = 0; i < INTERN_SHARDS; i++) {
+    InternShard *shard = &interner->shards[i];
+    shard->nslots = INIT_SLOTS;
+    shard->slots = alloc_slots(interner, shard->nslots);
+    vector_init(&shard->names, sizeof(SourcePosition), interner->pool);
+  }
+}
+
+void
+interner_deinit(Interner *interner) {
+  for (size_t i = 0; i < INTERN_SHARDS; i++) {
+    pthread_mutex_destroy(&interner->shards[i].lock);
+  }
+  pthread_mutex_destroy(&interner->pool_lock);
+  if (interner->owns_pool) {
+    mempool_deinit(&interner->own_pool);
+  }
+}
+
+static void
+shard_grow(Interner *interner, InternShard *shard) {
+  InternSlot *old_slots = shard->slots;
+  size_t old_nslots = shard->nslots;
+
+  shard->nslots *= 2;
+  shard->slots = alloc_slots(interner, shard->nslots);
+  size_t mask = shard->nslots - 1;
+  for (size_t i = 0; i < old_nslots; i++) {
+    if (old_slots[i].atom == 0) {
+      continue;
+    }
+    size_t idx = old_slots[i].hash & mask;
+    while (shard->slots[idx].atom != 0) {
+      idx = (idx + 1) & mask;
+    }
+    shard->slots[idx] = old_slots[i];
+  }
+}
+
+Atom
+intern(Interner *interner, SourcePosition name) {
+  uint32_t hash = (uint32_t)hash_bytes(name.start, name.sz, 0);
+  /* the top bits pick the shard, the low bits the slot inside it */
+  size_t shard_idx = hash >> (32 - INTERN_SHARD_BITS);
+  InternShard *shard = &interner->shards[shard_idx];
+
+  pthread_mutex_lock(&shard->lock);
+  size_t mask = shard->nslots - 1;
+  size_t idx = hash & mask;
+  for (; shard->slots[idx].atom != 0; idx = (idx + 1) & mask) {
+    InternSlot *slot = &shard->slots[idx];
+    if (slot->hash != hash) {
+      continue;
+    }
+    SourcePosition *other = vector_idx(
+        &shard->names, (slot->atom - 1) >> INTERN_SHARD_BITS);
+    if (other->sz == name.sz &&
+        memcmp(other->start, name.start, name.sz) == 0) {
+      Atom atom = slot->atom;
+      pthread_mutex_unlock(&shard->lock);
+      return atom;
+    }
+  }
+
+  Atom atom = ((shard->names.items << INTERN_SHARD_BITS) | shard_idx) + 1;
+  pthread_mutex_lock(&interner->pool_lock);
+  vector_push(&shard->names, &name);
+  pthread_mutex_unlock(&interner->pool_lock);
+  shard->slots[idx].hash = hash;
+  shard->slots[idx].atom = atom;
+
+  /* keep the load factor under 1/2 for short linear probes */
+  if (shard->names.items * 2 >= shard->nslots) {
+    shard_grow(interner, shard);
+  }
+  pthread_mutex_unlock(&shard->lock);
+  return atom;
+}
+
+SourcePosition
+atom_name(Interner *interner, Atom atom) {
+  InternShard *shard =
+      &interner->shards[(atom - 1) & (INTERN_SHARDS - 1)];
+  pthread_mutex_lock(&shard->lock);
+  SourcePosition name = *(SourcePosition *)vector_idx(
+      &shard->names, (atom - 1) >> INTERN_SHARD_BITS);
+  pthread_mutex_unlock(&shard->lock);
+  return name;
+}
@@ -2,6 +2,8 @@
 
 #include <stdlib.h>
 
+#include "jobs.h"
+
 static int
 type_sz(int ast_type) {
   switch (ast_type) {
@@ -10,7 +12,6 @@ type_sz(int ast_type) {
       return SZ_8;
     case TYPE_I16:
     case TYPE_U16:
-      printf("here\n");
       return SZ_16;
     case TYPE_I32:
     case TYPE_U32:
@@ -62,95 +63,104 @@ inst_init(SSA_Inst *inst, int t, int sz, RegId result) {
   inst->result = result;
 }
 
+/* Translates the nodes first..last, which are the expression of a
+ * statement, and returns the register holding last.  regs maps every node to
+ * the register holding its value. */
 static RegId
-translate_expr(Expr *expr, Scope *scope, SSA_BBlock *block, SSA_Fn *fn,
-               MemPool *pool) {
-  switch (expr->t) {
-    case EXPR_INT:
-      {
-        SSA_Inst *inst = bblock_append(block);
-        inst_init(inst, INST_IMM, type_sz(expr->type->t),
-                  ssa_new_reg(fn, type_sz(expr->type->t)));
-        inst->data.imm = expr->data.intlit.val;
-        return inst->result;
-      }
-    case EXPR_VAR:
-      {
-        return sym_table_reg(fn, expr->data.var);
-      }
-    case EXPR_BINOP:
-      {
-        RegId obj1 =
-            translate_expr(expr->data.binop.left, scope, block, fn, pool);
-        RegId obj2 =
-            translate_expr(expr->data.binop.right, scope, block, fn, pool);
-        SSA_Inst *inst = bblock_append(block);
-        inst->sz = type_sz(expr->type->t);
-        inst->t = translate_binop(expr->type->t, expr->data.binop.op);
-        inst->data.operands[0] = obj1;
-        inst->data.operands[1] = obj2;
-        inst->result = ssa_new_reg(fn, type_sz(expr->type->t));
-        return inst->result;
-      }
-    case EXPR_FUNCALL:
-      {
-        Vector passed_params;
-        vector_init(&passed_params, sizeof(RegId), pool);
-        for (size_t i = 0; i < expr->data.funcall.args.items; i++) {
-          Expr *temp_expr = *((Expr **)vector_idx(&expr->data.funcall.args, i));
-          RegId temp_id = translate_expr(temp_expr, scope, block, fn, pool);
-          vector_push(&passed_params, &temp_id);
+translate_exprs(ExprTable *exprs, ExprId first, ExprId last, RegId *regs,
+                SSA_BBlock *block, SSA_Fn *fn, MemPool *pool) {
+  for (ExprId expr = first; expr <= last; expr++) {
+    int sz = type_sz(exprs->types[expr]->t);
+    switch (expr_kind(exprs, expr)) {
+      case EXPR_INT:
+        {
+          SSA_Inst *inst = bblock_append(block);
+          inst_init(inst, INST_IMM, sz, ssa_new_reg(fn, sz));
+          inst->data.imm = expr_int_val(exprs, expr);
+          regs[expr] = inst->result;
+          break;
         }
-        SSA_Inst *inst = bblock_append(block);
-        inst_init(inst, INST_CALLFN, type_sz(expr->type->t),
-                  ssa_new_reg(fn, type_sz(expr->type->t)));
-        if (expr->data.funcall.fn->inf.fn == NULL) {
-          log_internal_err("cannot call runtime selected functions", NULL);
+      case EXPR_VAR:
+        regs[expr] = sym_table_reg(fn, *expr_entry(exprs, expr));
+        break;
+      case EXPR_BINOP:
+        {
+          SSA_Inst *inst = bblock_append(block);
+          inst->sz = sz;
+          inst->t = translate_binop(exprs->types[expr]->t, exprs->subs[expr]);
+          inst->data.operands[0] = regs[exprs->a[expr]];
+          inst->data.operands[1] = regs[exprs->b[expr]];
+          inst->result = ssa_new_reg(fn, sz);
+          regs[expr] = inst->result;
+          break;
         }
-        inst->data.callfn.fn = expr->data.funcall.fn->inf.fn;
-        inst->data.callfn.args = passed_params;
-        return inst->result;
-      }
-    default:
-      log_internal_err("invalid expression type %d", expr->t);
-      exit(EXIT_FAILURE);
+      case EXPR_FUNCALL:
+        {
+          uint32_t nargs = expr_call_nargs(exprs, expr);
+          const ExprId *args = expr_call_args(exprs, expr);
+          Vector passed_params;
+          vector_init_size(&passed_params, sizeof(RegId), pool, nargs);
+          for (size_t i = 0; i < nargs; i++) {
+            ((RegId *)passed_params.data)[i] = regs[args[i]];
+          }
+          SSA_Inst *inst = bblock_append(block);
+          inst_init(inst, INST_CALLFN, sz, ssa_new_reg(fn, sz));
+          ScopeEntry *callee = *expr_entry(exprs, expr);
+          if (callee->inf.fn == NULL) {
+            log_internal_err("cannot call runtime selected functions", NULL);
+          }
+          inst->data.callfn.fn = callee->inf.fn;
+          inst->data.callfn.args = passed_params;
+          regs[expr] = inst->result;
+          break;
+        }
+      default:
+        log_internal_err("invalid expression type %d",
+                         expr_kind(exprs, expr));
+    }
   }
+  return regs[last];
 }
 
 static void
-translate_stmt(Stmt *stmt, Scope *scope, SSA_BBlock *block, SSA_Fn *fn,
-               MemPool *pool) {
+translate_stmt(Stmt *stmt, ExprTable *exprs, ExprId first, RegId *regs,
+               SSA_BBlock *block, SSA_Fn *fn, MemPool *pool) {
   switch (stmt->t) {
     case STMT_LET:
-      if (stmt->data.let.value != NULL) {
-        RegId obj =
-            translate_expr(stmt->data.let.value, scope, block, fn, pool);
+      if (stmt->data.let.value != EXPR_NONE) {
+        RegId obj = translate_exprs(exprs, first, stmt->data.let.value, regs,
+                                    block, fn, pool);
         SSA_Inst *inst = bblock_append(block);
 
-        inst_init(inst, INST_COPY, type_sz(stmt->data.let.value->type->t),
+        inst_init(inst, INST_COPY,
+                  type_sz(exprs->types[stmt->data.let.value]->t),
                   sym_table_reg(fn, stmt->data.let.var));
         inst->data.operands[0] = obj;
       }
       break;
     case STMT_EXPR:
       {
-        RegId op = translate_expr(stmt->data.expr, scope, block, fn, pool);
+        RegId op = translate_exprs(exprs, first, stmt->data.expr, regs, block,
+                                   fn, pool);
         SSA_Inst *inst = bblock_append(block);
-        inst_init(inst, INST_COPY, type_sz(stmt->data.expr->type->t), 0);
+        inst_init(inst, INST_COPY, type_sz(exprs->types[stmt->data.expr]->t),
+                  0);
         inst->data.operands[0] = op;
         break;
       }
     case STMT_RETURN:
       {
         RegId op = 0;
-        if (stmt->data.ret != NULL) {
-          op = translate_expr(stmt->data.ret, scope, block, fn, pool);
+        if (stmt->data.ret != EXPR_NONE) {
+          op = translate_exprs(exprs, first, stmt->data.ret, regs, block, fn,
+                               pool);
         }
         SSA_Inst *inst = bblock_append(block);
-        inst_init(inst, INST_RET, 0,
-                  stmt->data.let.value == NULL
+        inst_init(inst, INST_RET,
+                  stmt->data.ret == EXPR_NONE
                       ? SZ_NONE
-                      : type_sz(stmt->data.ret->type->t));
+                      : type_sz(exprs->types[stmt->data.ret]->t),
+                  0);
         inst->data.operands[0] = op;
         break;
       }
@@ -160,7 +170,8 @@ translate_stmt(Stmt *stmt, Scope *scope, SSA_BBlock *block, SSA_Fn *fn,
 }
 
 void
-translate_function(Function *fn, SSA_Fn *sem_fn, MemPool *pool) {
+translate_function(Function *fn, SSA_Fn *sem_fn, MemPool *pool,
+                   MemPool *scratch) {
   SSA_BBlock *block = bblock_init(pool);
   vector_init(&sem_fn->params, sizeof(RegId), pool);
   vector_init(&sem_fn->regs, sizeof(SSA_Reg), pool);
@@ -170,26 +181,56 @@ translate_function(Function *fn, SSA_Fn *sem_fn, MemPool *pool) {
     vector_push(&sem_fn->params, &temp);
   }
 
+  MemPoolMark mark = mempool_mark(scratch);
+  RegId *regs = mempool_alloc(scratch, sizeof(RegId) * fn->exprs.count);
+  ExprId first = EXPR_NONE + 1;
   for (size_t i = 0; i < fn->body.stmts.items; i++) {
-    translate_stmt(vector_idx(&fn->body.stmts, i), fn->scope, block, sem_fn,
-                   pool);
+    Stmt *stmt = vector_idx(&fn->body.stmts, i);
+    translate_stmt(stmt, &fn->exprs, first, regs, block, sem_fn, pool);
+    if (stmt_expr(stmt) != EXPR_NONE) {
+      first = stmt_expr(stmt) + 1;
+    }
   }
+  mempool_release(scratch, mark);
+
+  vector_freeze(&block->insts);
+  vector_freeze(&sem_fn->regs);
   sem_fn->name = fn->name;
   sem_fn->entry = block;
 }
 
+typedef struct {
+  AST *ast;
+  SSA_Prog *prog;
+} TranslateJob;
+
+static void
+translate_fn_job(void *ctx, size_t idx, size_t worker) {
+  TranslateJob *job = ctx;
+  Function *fn = vector_idx(&job->ast->fns, idx);
+  if (!fn->cached) {
+    translate_function(fn, vector_idx(&job->prog->fns, idx),
+                       &job->prog->worker_pools[worker],
+                       &job->ast->scratch_pools[worker]);
+  }
+}
+
 void
-translate_ast(AST *ast, SSA_Prog *prog) {
-  mempool_init(&prog->pool);
-  vector_init(&prog->fns, sizeof(SSA_Fn), &prog->pool);
+ssa_prog_declare_fns(SSA_Prog *prog, AST *ast) {
+  /* sized up front, calls keep pointers to the functions they call */
+  vector_init_size(&prog->fns, sizeof(SSA_Fn), prog->pool, ast->fns.items);
+  prog->jobs = &ast->jobs;
 
   for (size_t i = 0; i < ast->fns.items; i++) {
     Function *fn = vector_idx(&ast->fns, i);
-    SSA_Fn *ssa_fn = vector_alloc(&prog->fns);
-    fn->entry->inf.fn = ssa_fn;
-  }
-  for (size_t i = 0; i < ast->fns.items; i++) {
-    translate_function(vector_idx(&ast->fns, i), vector_idx(&prog->fns, i),
-                       &prog->pool);
+    SSA_Fn *sem_fn = vector_idx(&prog->fns, i);
+    sem_fn->pure = 0;
+    fn->entry->inf.fn = sem_fn;
   }
 }
+
+void
+translate_ast(AST *ast, SSA_Prog *prog) {
+  TranslateJob job = {.ast = ast, .prog = prog};
+  parallel_for(&ast->jobs, ast->fns.items, translate_fn_job, &job);
+}
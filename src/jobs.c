@@ -0,0 +1,221 @@
+#define _GNU_SOURCE
+#include "jobs.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "helper.h"
+
+/* no job has failed */
+#define NO_FAILURE SIZE_MAX
+
+typedef struct JobQueue {
+  JobFn fn;
+  void *ctx;
+  size_t n;
+  size_t next; /* next index to hand out, shared by the workers */
+  uint64_t *times; /* NULL if jobs are not timed */
+
+  pthread_mutex_t lock;
+  /* lowest index whose job failed and its error.  Indices are handed out in
+   * order, so every job still to start after a failure is past it. */
+  size_t failed;
+  Diagnostic diag;
+} JobQueue;
+
+/* idx holds the job being run, for when it fails */
+static void
+run_jobs(JobQueue *queue, size_t worker, volatile size_t *idx) {
+  while (1) {
+    *idx = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED);
+    if (*idx >= queue->n ||
+        *idx > __atomic_load_n(&queue->failed, __ATOMIC_RELAXED)) {
+      return;
+    }
+    if (queue->times == NULL) {
+      queue->fn(queue->ctx, *idx, worker);
+    } else {
+      uint64_t start = wall_time_ns();
+      queue->fn(queue->ctx, *idx, worker);
+      queue->times[*idx] += wall_time_ns() - start;
+    }
+  }
+}
+
+/* Every worker catches its errors, even if the caller has no sink, so that
+ * the error reported is the one of the lowest failing index, as it is when
+ * the jobs run one after another */
+static void
+run_worker(JobQueue *queue, size_t worker) {
+  volatile size_t idx = 0;
+  DiagSink sink;
+  DiagSink *prev = diag_sink_set(&sink);
+  if (setjmp(sink.env) == 0) {
+    run_jobs(queue, worker, &idx);
+  } else {
+    pthread_mutex_lock(&queue->lock);
+    if (idx < queue->failed) {
+      queue->diag = sink.diag;
+      __atomic_store_n(&queue->failed, idx, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&queue->lock);
+  }
+  diag_sink_set(prev);
+}
+
+typedef struct {
+  JobPool *pool;
+  size_t worker;
+} Worker;
+
+/* sleeps until a queue it takes part in is posted or the pool stops */
+static void *
+pool_main(void *arg) {
+  Worker *worker = arg;
+  JobPool *pool = worker->pool;
+  uint64_t seen = 0;
+
+  pthread_mutex_lock(&pool->lock);
+  while (1) {
+    while (!pool->stop && pool->generation == seen) {
+      pthread_cond_wait(&pool->posted, &pool->lock);
+    }
+    if (pool->stop) {
+      break;
+    }
+    seen = pool->generation;
+    /* queue may already be done if this thread does not take part in it */
+    if (worker->worker >= pool->posted_workers) {
+      continue;
+    }
+    JobQueue *queue = pool->queue;
+    pthread_mutex_unlock(&pool->lock);
+
+    run_worker(queue, worker->worker);
+
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->busy == 0) {
+      pthread_cond_signal(&pool->done);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+  free(worker);
+  return NULL;
+}
+
+static pthread_key_t times_key;
+static pthread_once_t times_once = PTHREAD_ONCE_INIT;
+
+static void
+make_times_key(void) {
+  pthread_key_create(&times_key, NULL);
+}
+
+static uint64_t *
+job_times_get(void) {
+  pthread_once(&times_once, make_times_key);
+  return pthread_getspecific(times_key);
+}
+
+uint64_t *
+job_times_set(uint64_t *times) {
+  uint64_t *prev = job_times_get();
+  pthread_setspecific(times_key, times);
+  return prev;
+}
+
+/* more than enough for any machine this runs on */
+#define MAX_WORKERS 256
+
+void
+job_pool_init(JobPool *pool, size_t nworkers) {
+  if (nworkers > MAX_WORKERS) {
+    nworkers = MAX_WORKERS;
+  }
+  pool->nworkers = nworkers;
+  pool->queue = NULL;
+  pool->generation = 0;
+  pool->posted_workers = 0;
+  pool->busy = 0;
+  pool->stop = 0;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->posted, NULL);
+  pthread_cond_init(&pool->done, NULL);
+
+  pool->threads = malloc(sizeof(pthread_t) * nworkers);
+  if (pool->threads == NULL) {
+    log_internal_err("unable to allocate %zu worker threads", nworkers);
+  }
+  for (size_t i = 1; i < nworkers; i++) {
+    Worker *worker = malloc(sizeof(Worker));
+    if (worker == NULL) {
+      log_internal_err("unable to allocate worker %zu", i);
+    }
+    worker->pool = pool;
+    worker->worker = i;
+    if (pthread_create(&pool->threads[i], NULL, pool_main, worker) != 0) {
+      log_internal_err("unable to start worker thread %zu", i);
+    }
+  }
+}
+
+void
+job_pool_deinit(JobPool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = 1;
+  pthread_cond_broadcast(&pool->posted);
+  pthread_mutex_unlock(&pool->lock);
+  for (size_t i = 1; i < pool->nworkers; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+  free(pool->threads);
+  pthread_cond_destroy(&pool->done);
+  pthread_cond_destroy(&pool->posted);
+  pthread_mutex_destroy(&pool->lock);
+}
+
+void
+parallel_for(JobPool *pool, size_t n, JobFn fn, void *ctx) {
+  size_t nworkers = pool == NULL ? 1 : pool->nworkers;
+  if (nworkers > n) {
+    nworkers = n;
+  }
+
+  JobQueue queue = {.fn = fn,
+                    .ctx = ctx,
+                    .n = n,
+                    .next = 0,
+                    .times = job_times_get(),
+                    .failed = NO_FAILURE};
+  pthread_mutex_init(&queue.lock, NULL);
+
+  if (nworkers > 1) {
+    pthread_mutex_lock(&pool->lock);
+    pool->queue = &queue;
+    pool->posted_workers = nworkers;
+    pool->busy = nworkers - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->posted);
+    pthread_mutex_unlock(&pool->lock);
+  }
+
+  /* the calling thread is worker 0 */
+  run_worker(&queue, 0);
+
+  if (nworkers > 1) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy > 0) {
+      pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pool->queue = NULL;
+    pthread_mutex_unlock(&pool->lock);
+  }
+  pthread_mutex_destroy(&queue.lock);
+  if (queue.failed != NO_FAILURE) {
+    if (diag_sink_get() != NULL) {
+      diag_rethrow(&queue.diag);
+    }
+    diag_report_final(&queue.diag);
+  }
+}
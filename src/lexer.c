@@ -1,305 +1,463 @@
 #include "lexer.h"
 
-#include <ctype.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "helper.h"
 
-struct {
-  const uint8_t *buf;
-  size_t sz;
+/* The scanning loops for identifier, digit and whitespace runs classify a
+ * whole vector of bytes per step when the target supports it.  This only
+ * helps runs longer than a vector, typical tokens lex as fast either way (see
+ * the lexer benchmark in the README).  Define BCC2_SCALAR_LEXER to force the
+ * byte-at-a-time fallback. */
+#if defined(__AVX2__) && !defined(BCC2_SCALAR_LEXER)
+#include <immintrin.h>
+#define LEXER_AVX2
+const char *const lexer_scan_impl = "avx2";
+#elif defined(__SSE2__) && !defined(BCC2_SCALAR_LEXER)
+#include <emmintrin.h>
+#define LEXER_SSE2
+const char *const lexer_scan_impl = "sse2";
+#else
+const char *const lexer_scan_impl = "scalar";
+#endif
 
-  size_t end;
-  size_t start;
+/* Classes of every byte, so that each scalar test is a single load.  ASCII
+ * only, so unlike <ctype.h> they do not depend on the locale. */
+enum {
+  CC_DIGIT = 1 << 0,
+  CC_SYMBOL = 1 << 1, /* may appear in an identifier */
+  CC_BLANK = 1 << 2,  /* space or tab */
+  CC_NEWLINE = 1 << 3,
+};
 
-  int prev;
-  Token peek;
-  int peekf; /* 0 if no token available to peek */
-} lex;
+#define CC_ALPHA(c) [c] = CC_SYMBOL, [(c) - 'a' + 'A'] = CC_SYMBOL
+#define CC_NUM(c) [c] = CC_DIGIT | CC_SYMBOL
+
+static const uint8_t char_class[256] = {
+    CC_ALPHA('a'), CC_ALPHA('b'), CC_ALPHA('c'), CC_ALPHA('d'), CC_ALPHA('e'),
+    CC_ALPHA('f'), CC_ALPHA('g'), CC_ALPHA('h'), CC_ALPHA('i'), CC_ALPHA('j'),
+    CC_ALPHA('k'), CC_ALPHA('l'), CC_ALPHA('m'), CC_ALPHA('n'), CC_ALPHA('o'),
+    CC_ALPHA('p'), CC_ALPHA('q'), CC_ALPHA('r'), CC_ALPHA('s'), CC_ALPHA('t'),
+    CC_ALPHA('u'), CC_ALPHA('v'), CC_ALPHA('w'), CC_ALPHA('x'), CC_ALPHA('y'),
+    CC_ALPHA('z'),
+    CC_NUM('0'), CC_NUM('1'), CC_NUM('2'), CC_NUM('3'), CC_NUM('4'),
+    CC_NUM('5'), CC_NUM('6'), CC_NUM('7'), CC_NUM('8'), CC_NUM('9'),
+    ['_'] = CC_SYMBOL,
+    [' '] = CC_BLANK,
+    ['\t'] = CC_BLANK,
+    ['\n'] = CC_NEWLINE,
+};
+
+static inline int
+is_digit(uint8_t c) {
+  return char_class[c] & CC_DIGIT;
+}
+
+static inline int
+is_symbol_char(uint8_t c) {
+  return char_class[c] & CC_SYMBOL;
+}
 
 void
-lexer_init(const uint8_t *buf, size_t sz) {
-  lex.buf = buf;
-  lex.sz = sz;
+lexer_init(Lexer *lex, const uint8_t *buf, size_t sz,
+           Interner *interner) {
+  lex->buf = buf;
+  lex->sz = sz;
+  lex->interner = interner;
 
-  lex.end = lex.start = 0;
+  lex->end = lex->start = 0;
 
-  lex.peekf = 0;
+  lex->prev = TOK_NEWLINE;
+  lex->peekf = 0;
 }
 
 static inline size_t
-cur_len() {
-  return lex.end - lex.start;
+cur_len(Lexer *lex) {
+  return lex->end - lex->start;
 }
 
 static Token
-make_token(int t) {
+make_token(Lexer *lex, int t) {
   Token ret;
-  ret.pos.start = lex.buf + lex.start;
-  ret.pos.sz = cur_len();
+  ret.pos.start = lex->buf + lex->start;
+  ret.pos.sz = cur_len(lex);
   ret.t = t;
-  lex.start = lex.end; /* reset lexer */
+  ret.intlit_type = INTLIT_I64_NONE;
+  ret.atom = 0;
+  lex->start = lex->end; /* reset lexer */
   return ret;
 }
 
 static int
-is_eof() {
-  return lex.end >= lex.sz;
+is_eof(Lexer *lex) {
+  return lex->end >= lex->sz;
 }
 
-static inline int
-is_whitespace(int32_t c) {
-  return c == ' ' || c == '\n' || c == '\t';
-}
+#if defined(LEXER_AVX2)
+#define LEXER_SIMD
+typedef __m256i ScanVec;
+#define SCAN_WIDTH 32
+#define vec_load(p) _mm256_loadu_si256((const __m256i *)(p))
+#define vec_set1(c) _mm256_set1_epi8(c)
+#define vec_eq(a, b) _mm256_cmpeq_epi8(a, b)
+#define vec_gt(a, b) _mm256_cmpgt_epi8(a, b)
+#define vec_or(a, b) _mm256_or_si256(a, b)
+#define vec_and(a, b) _mm256_and_si256(a, b)
+#define vec_mask(v) ((uint32_t)_mm256_movemask_epi8(v))
+#elif defined(LEXER_SSE2)
+#define LEXER_SIMD
+typedef __m128i ScanVec;
+#define SCAN_WIDTH 16
+#define vec_load(p) _mm_loadu_si128((const __m128i *)(p))
+#define vec_set1(c) _mm_set1_epi8(c)
+#define vec_eq(a, b) _mm_cmpeq_epi8(a, b)
+#define vec_gt(a, b) _mm_cmpgt_epi8(a, b)
+#define vec_or(a, b) _mm_or_si128(a, b)
+#define vec_and(a, b) _mm_and_si128(a, b)
+#define vec_mask(v) ((uint32_t)_mm_movemask_epi8(v))
+#endif
 
-static inline uint8_t
-next_c() {
-  return lex.buf[lex.end++];
-}
+#ifdef LEXER_SIMD
+#define SCAN_FULL ((uint32_t)((1ull << SCAN_WIDTH) - 1))
 
-static inline uint8_t
-peek_c() {
-  return lex.buf[lex.end];
+/* Byte compares are signed, so anything >= 0x80 falls outside every range */
+static inline ScanVec
+vec_in_range(ScanVec v, char lo, char hi) {
+  return vec_and(vec_gt(v, vec_set1(lo - 1)), vec_gt(vec_set1(hi + 1), v));
 }
 
-static inline int
-needs_newline() {
-  return lex.prev == TOK_INT || lex.prev == TOK_SYM || lex.prev == TOK_FALSE ||
-         lex.prev == TOK_TRUE || lex.prev == TOK_U8 || lex.prev == TOK_I8 ||
-         lex.prev == TOK_U16 || lex.prev == TOK_I16 || lex.prev == TOK_U32 ||
-         lex.prev == TOK_I32 || lex.prev == TOK_U64 || lex.prev == TOK_I64 ||
-         lex.prev == TOK_BOOL || lex.prev == TOK_LPAREN ||
-         lex.prev == TOK_RPAREN;
+/* Returns the offset of the first byte that is not set in the mask, or
+ * SCAN_WIDTH if the whole vector matched */
+static inline size_t
+first_miss(ScanVec matched) {
+  uint32_t miss = ~vec_mask(matched) & SCAN_FULL;
+  return miss ? (size_t)__builtin_ctz(miss) : SCAN_WIDTH;
 }
+#endif
 
-static int
-skip_whitespace() {
-  int c;
-  while (!is_eof() && is_whitespace(peek_c())) {
-    if ((c = peek_c()) == '\t' || c == ' ') {
-      next_c();
-    } else if (c == '\n' && needs_newline()) {
-      lex.start = lex.end;
-      return 1;
-    } else {
-      next_c();
+/* The scan_* functions return a pointer to the first byte in [p, end) that
+ * is not part of the run.  The vector loops never read past end, so they are
+ * safe on an mmapped file that ends exactly on a page boundary. */
+
+static const uint8_t *
+scan_symbol(const uint8_t *p, const uint8_t *end) {
+#ifdef LEXER_SIMD
+  while (end - p >= SCAN_WIDTH) {
+    ScanVec v = vec_load(p);
+    ScanVec alpha = vec_in_range(vec_or(v, vec_set1(0x20)), 'a', 'z');
+    ScanVec digit = vec_in_range(v, '0', '9');
+    ScanVec under = vec_eq(v, vec_set1('_'));
+    size_t n = first_miss(vec_or(vec_or(alpha, digit), under));
+    p += n;
+    if (n != SCAN_WIDTH) {
+      return p;
     }
   }
-  lex.start = lex.end;
-  return 0;
+#endif
+  while (p < end && is_symbol_char(*p)) {
+    p++;
+  }
+  return p;
 }
 
-static inline int
-match(int t, const char *name) {
-  if (strlen(name) != cur_len()) {
-    return TOK_SYM;
+static const uint8_t *
+scan_digits(const uint8_t *p, const uint8_t *end) {
+#ifdef LEXER_SIMD
+  while (end - p >= SCAN_WIDTH) {
+    size_t n = first_miss(vec_in_range(vec_load(p), '0', '9'));
+    p += n;
+    if (n != SCAN_WIDTH) {
+      return p;
+    }
   }
-  if (strncmp((char *)name, (char *)lex.buf + lex.start, cur_len()) == 0) {
-    return t;
+#endif
+  while (p < end && is_digit(*p)) {
+    p++;
   }
-  return TOK_SYM;
+  return p;
 }
 
-static int
-pick_symbol_type() {
-  switch (lex.buf[lex.start]) {
-    case 't':
-      return match(TOK_TRUE, "true");
-    case 'r':
-      return match(TOK_RETURN, "return");
-    case 'f':
-      return match(TOK_FALSE, "false");
-    case 'b':
-      return match(TOK_BOOL, "bool");
-    case 'm':
-      return match(TOK_MUT, "mut");
-    case 'l':
-      return match(TOK_LET, "let");
-    case 'u':
-      if (cur_len() < 2) {
-        return TOK_SYM;
-      }
-      switch (lex.buf[lex.start + 1]) {
-        case '8':
-          return match(TOK_U8, "u8");
-        case '1':
-          return match(TOK_U16, "u16");
-        case '3':
-          return match(TOK_U32, "u32");
-        case '6':
-          return match(TOK_U64, "u64");
-      }
-      break;
-    case 'i':
-      if (cur_len() < 2) {
-        return TOK_SYM;
-      }
-      switch (lex.buf[lex.start + 1]) {
-        case '8':
-          return match(TOK_I8, "i8");
-        case '1':
-          return match(TOK_I16, "i16");
-        case '3':
-          return match(TOK_I32, "i32");
-        case '6':
-          return match(TOK_I64, "i64");
-      }
-      break;
+/* skips spaces and tabs, and newlines as well if skip_newlines is set */
+static const uint8_t *
+scan_blanks(const uint8_t *p, const uint8_t *end, int skip_newlines) {
+#ifdef LEXER_SIMD
+  /* comparing against ' ' twice is cheaper than branching in the loop */
+  ScanVec newline = vec_set1(skip_newlines ? '\n' : ' ');
+  while (end - p >= SCAN_WIDTH) {
+    ScanVec v = vec_load(p);
+    ScanVec blank = vec_or(vec_eq(v, vec_set1(' ')), vec_eq(v, vec_set1('\t')));
+    size_t n = first_miss(vec_or(blank, vec_eq(v, newline)));
+    p += n;
+    if (n != SCAN_WIDTH) {
+      return p;
+    }
   }
-  return TOK_SYM;
+#endif
+  uint8_t mask = skip_newlines ? CC_BLANK | CC_NEWLINE : CC_BLANK;
+  while (p < end && (char_class[*p] & mask)) {
+    p++;
+  }
+  return p;
 }
 
-static Token
-make_symbol() {
-  int c;
-  while (!is_eof() && (isalpha(c = peek_c()) || isdigit(c) || c == '_')) {
-    next_c();
-  }
-  return make_token(pick_symbol_type());
+static inline uint8_t
+next_c(Lexer *lex) {
+  return lex->buf[lex->end++];
+}
+
+static inline uint8_t
+peek_c(Lexer *lex) {
+  return lex->buf[lex->end];
+}
+
+static inline int
+needs_newline(Lexer *lex) {
+  int prev = lex->prev;
+  return prev == TOK_INT || prev == TOK_SYM || prev == TOK_FALSE ||
+         prev == TOK_TRUE || prev == TOK_U8 || prev == TOK_I8 ||
+         prev == TOK_U16 || prev == TOK_I16 || prev == TOK_U32 ||
+         prev == TOK_I32 || prev == TOK_U64 || prev == TOK_I64 ||
+         prev == TOK_BOOL || prev == TOK_LPAREN || prev == TOK_RPAREN;
 }
 
 static int
-next_matches(const char *text) {
-  size_t len = strlen(text);
-  if (lex.end + len >= lex.sz) {
-    return 0;
+skip_whitespace(Lexer *lex) {
+  const uint8_t *end = lex->buf + lex->sz;
+  const uint8_t *p =
+      scan_blanks(lex->buf + lex->end, end, !needs_newline(lex));
+  lex->start = lex->end = p - lex->buf;
+  /* only stops on a newline if it is significant */
+  return p != end && *p == '\n';
+}
+
+/* Keywords, type names and integer literal suffixes are recognized with a
+ * perfect hash over the first two bytes and the length.  The table indices
+ * are constant expressions, so a new keyword that collides with an existing
+ * one is rejected by -Woverride-init; pick new multipliers if that happens. */
+#define KW_HASH(c0, c1, len) (((c0)*2 + (c1)*7 + (len)) & 31)
+#define KW_MAX_LEN 6
+
+typedef struct {
+  char name[KW_MAX_LEN];
+  uint8_t len;
+  uint8_t t;      /* TokKind */
+  uint8_t intlit; /* IntlitKind, INTLIT_I64_NONE if not a literal suffix */
+} Keyword;
+
+#define KW(c0, c1, str, tok, lit)                                              \
+  [KW_HASH(c0, c1, sizeof(str) - 1)] = {str, sizeof(str) - 1, tok, lit}
+
+static const Keyword keywords[32] = {
+    KW('t', 'r', "true", TOK_TRUE, INTLIT_I64_NONE),
+    KW('f', 'a', "false", TOK_FALSE, INTLIT_I64_NONE),
+    KW('r', 'e', "return", TOK_RETURN, INTLIT_I64_NONE),
+    KW('b', 'o', "bool", TOK_BOOL, INTLIT_I64_NONE),
+    KW('m', 'u', "mut", TOK_MUT, INTLIT_I64_NONE),
+    KW('l', 'e', "let", TOK_LET, INTLIT_I64_NONE),
+    KW('u', '8', "u8", TOK_U8, INTLIT_U8),
+    KW('u', '1', "u16", TOK_U16, INTLIT_U16),
+    KW('u', '3', "u32", TOK_U32, INTLIT_U32),
+    KW('u', '6', "u64", TOK_U64, INTLIT_U64),
+    KW('i', '8', "i8", TOK_I8, INTLIT_I8),
+    KW('i', '1', "i16", TOK_I16, INTLIT_I16),
+    KW('i', '3', "i32", TOK_I32, INTLIT_I32),
+    KW('i', '6', "i64", TOK_I64, INTLIT_I64),
+};
+
+/* returns NULL if the lexeme is not a keyword */
+static inline const Keyword *
+find_keyword(const uint8_t *str, size_t len) {
+  if (len < 2 || len > KW_MAX_LEN) {
+    return NULL;
+  }
+  const Keyword *kw = &keywords[KW_HASH(str[0], str[1], len)];
+  if (kw->len != len || memcmp(kw->name, str, len) != 0) {
+    return NULL;
   }
-  if (strncmp(text, (char *)lex.buf + lex.end, len) == 0) {
-    lex.end += len;
-    return 1;
+  return kw;
+}
+
+static Token
+make_symbol(Lexer *lex) {
+  lex->end = scan_symbol(lex->buf + lex->end, lex->buf + lex->sz) - lex->buf;
+  const Keyword *kw = find_keyword(lex->buf + lex->start, cur_len(lex));
+  if (kw) {
+    return make_token(lex, kw->t);
   }
-  return 0;
+  Token tok = make_token(lex, TOK_SYM);
+  tok.atom = intern(lex->interner, tok.pos);
+  return tok;
 }
 
 static inline Token
-make_intlit(int type) {
-  Token tok = make_token(TOK_INT);
+make_intlit(Lexer *lex, int type) {
+  Token tok = make_token(lex, TOK_INT);
   tok.intlit_type = type;
   return tok;
 }
 
 static Token
-make_int() {
-  while (!is_eof() && isdigit(peek_c())) {
-    next_c();
+make_int(Lexer *lex) {
+  lex->end = scan_digits(lex->buf + lex->end, lex->buf + lex->sz) - lex->buf;
+
+  /* the suffix is only part of the literal if the whole symbol after the
+   * digits is a type name, otherwise it is lexed as a separate symbol */
+  const uint8_t *suffix = lex->buf + lex->end;
+  const uint8_t *suffix_end = scan_symbol(suffix, lex->buf + lex->sz);
+  const Keyword *kw = find_keyword(suffix, suffix_end - suffix);
+  if (kw && kw->intlit != INTLIT_I64_NONE) {
+    lex->end = suffix_end - lex->buf;
+    return make_intlit(lex, kw->intlit);
   }
-  if (next_matches("i8"))
-    return make_intlit(INTLIT_I8);
-  if (next_matches("u8"))
-    return make_intlit(INTLIT_U8);
-  if (next_matches("i16"))
-    return make_intlit(INTLIT_I16);
-  if (next_matches("u16"))
-    return make_intlit(INTLIT_U16);
-  if (next_matches("i32"))
-    return make_intlit(INTLIT_I32);
-  if (next_matches("u32"))
-    return make_intlit(INTLIT_U32);
-  if (next_matches("i64"))
-    return make_intlit(INTLIT_I64);
-  if (next_matches("u64"))
-    return make_intlit(INTLIT_U64);
-  return make_intlit(INTLIT_I64_NONE);
+  return make_intlit(lex, INTLIT_I64_NONE);
 }
 
 static Token
-match_character(int c, int t1, int t2) {
-  if (is_eof()) {
-    return make_token(t2);
+match_character(Lexer *lex, int c, int t1, int t2) {
+  if (is_eof(lex)) {
+    return make_token(lex, t2);
   }
 
-  if (peek_c() == c) {
-    next_c();
-    return make_token(t1);
+  if (peek_c(lex) == c) {
+    next_c(lex);
+    return make_token(lex, t1);
   }
-  return make_token(t2);
+  return make_token(lex, t2);
 }
 
 static Token
-lexer_fetch() {
+lexer_fetch(Lexer *lex) {
 
-  if (skip_whitespace()) {
-    return make_token(TOK_NEWLINE);
+  if (skip_whitespace(lex)) {
+    return make_token(lex, TOK_NEWLINE);
   }
 
-  if (is_eof())
-    return make_token(TOK_EOF);
+  if (is_eof(lex))
+    return make_token(lex, TOK_EOF);
 
-  int c = next_c();
-  if (isdigit(c)) {
-    return make_int();
+  int c = next_c(lex);
+  if (is_digit(c)) {
+    return make_int(lex);
   }
-  if (isalpha(c) || c == '_') {
-    return make_symbol();
+  if (is_symbol_char(c)) {
+    return make_symbol(lex);
   }
   switch (c) {
     case '+':
-      return make_token(TOK_ADD);
+      return make_token(lex, TOK_ADD);
     case '-':
-      return make_token(TOK_SUB);
+      return make_token(lex, TOK_SUB);
     case '*':
-      return make_token(TOK_MUL);
+      return make_token(lex, TOK_MUL);
     case '/':
-      return make_token(TOK_DIV);
+      return make_token(lex, TOK_DIV);
     case '=':
-      if (is_eof()) {
-        return make_token(TOK_EQ);
+      if (is_eof(lex)) {
+        return make_token(lex, TOK_EQ);
       }
-      if (peek_c() == '=') {
-        next_c();
-        return make_token(TOK_DEQ);
+      if (peek_c(lex) == '=') {
+        next_c(lex);
+        return make_token(lex, TOK_DEQ);
       }
-      return make_token(TOK_EQ);
+      return make_token(lex, TOK_EQ);
     case '>':
-      return match_character('=', TOK_GREQ, TOK_GR);
+      return match_character(lex, '=', TOK_GREQ, TOK_GR);
     case '<':
-      return match_character('=', TOK_LEEQ, TOK_LE);
+      return match_character(lex, '=', TOK_LEEQ, TOK_LE);
     case '!':
-      return match_character('=', TOK_NOT, TOK_NEQ);
+      return match_character(lex, '=', TOK_NEQ, TOK_NOT);
     case '(':
-      return make_token(TOK_LPAREN);
+      return make_token(lex, TOK_LPAREN);
     case ')':
-      return make_token(TOK_RPAREN);
+      return make_token(lex, TOK_RPAREN);
     case '{':
-      return make_token(TOK_LCURLY);
+      return make_token(lex, TOK_LCURLY);
     case '}':
-      return make_token(TOK_RCURLY);
+      return make_token(lex, TOK_RCURLY);
     case '[':
-      return make_token(TOK_LBRACK);
+      return make_token(lex, TOK_LBRACK);
     case ']':
-      return make_token(TOK_RBRACK);
+      return make_token(lex, TOK_RBRACK);
     case ';':
-      return make_token(TOK_NEWLINE);
+      return make_token(lex, TOK_NEWLINE);
     case ':':
-      return make_token(TOK_COLON);
+      return make_token(lex, TOK_COLON);
     case ',':
-      return make_token(TOK_COMMA);
+      return make_token(lex, TOK_COMMA);
   }
-  log_source_err("unexpected char '%c'", lex.buf,
-                 make_pos(lex.buf + lex.start, cur_len()), c);
-  return make_token(TOK_EOF); /* unreachable */
+  log_source_err("unexpected char '%c'", lex->buf,
+                 make_pos(lex->buf + lex->start, cur_len(lex)), c);
+  return make_token(lex, TOK_EOF); /* unreachable */
 }
 
 Token
-lexer_next() {
-  if (lex.peekf) {
-    lex.peekf = 0;
-    return lex.peek;
+lexer_next(Lexer *lex) {
+  if (lex->peekf) {
+    lex->peekf = 0;
+    return lex->peek;
   }
-  Token ret = lexer_fetch();
-  lex.prev = ret.t;
+  Token ret = lexer_fetch(lex);
+  lex->prev = ret.t;
   return ret;
 }
 
 Token
-lexer_peek() {
-  if (lex.peekf) {
-    return lex.peek;
+lexer_peek(Lexer *lex) {
+  if (lex->peekf) {
+    return lex->peek;
   }
-  Token ret = lexer_fetch();
-  lex.prev = ret.t;
-  lex.peekf = 1;
-  lex.peek = ret;
+  Token ret = lexer_fetch(lex);
+  lex->prev = ret.t;
+  lex->peekf = 1;
+  lex->peek = ret;
   return ret;
 }
+
+void
+lexer_tokenize(Lexer *lex, TokenBuffer *toks, MemPool *pool) {
+  if (lex->sz > UINT32_MAX) {
+    log_err_final("source files larger than 4 GiB are not supported");
+  }
+
+  Vector kinds, intlit_types, atoms, offsets, lens;
+  vector_init(&kinds, sizeof(uint8_t), pool);
+  vector_init(&intlit_types, sizeof(uint8_t), pool);
+  vector_init(&atoms, sizeof(Atom), pool);
+  vector_init(&offsets, sizeof(uint32_t), pool);
+  vector_init(&lens, sizeof(uint32_t), pool);
+
+  /* the arrays grow together so they can't grow in place, start them at a
+   * rough guess of one token per 6 bytes */
+  size_t guess = lex->sz / 6 + 16;
+  vector_reserve(&kinds, guess);
+  vector_reserve(&intlit_types, guess);
+  vector_reserve(&atoms, guess);
+  vector_reserve(&offsets, guess);
+  vector_reserve(&lens, guess);
+
+  /* a token that was peeked has already been consumed from the input */
+  Token tok = lex->peekf ? lex->peek : lexer_fetch(lex);
+  lex->peekf = 0;
+  while (1) {
+    lex->prev = tok.t;
+    *(uint8_t *)vector_alloc(&kinds) = tok.t;
+    *(uint8_t *)vector_alloc(&intlit_types) = tok.intlit_type;
+    *(Atom *)vector_alloc(&atoms) = tok.atom;
+    *(uint32_t *)vector_alloc(&offsets) = tok.pos.start - lex->buf;
+    *(uint32_t *)vector_alloc(&lens) = tok.pos.sz;
+    if (tok.t == TOK_EOF) {
+      break;
+    }
+    tok = lexer_fetch(lex);
+  }
+  vector_freeze(&lens);
+
+  toks->src = lex->buf;
+  toks->count = kinds.items;
+  toks->kinds = kinds.data;
+  toks->intlit_types = intlit_types.data;
+  toks->atoms = (Atom *)atoms.data;
+  toks->offsets = (uint32_t *)offsets.data;
+  toks->lens = (uint32_t *)lens.data;
+}
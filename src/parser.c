@@ -1,197 +1,324 @@
 #include "parser.h"
 
-#include <stdlib.h>
+#include <string.h>
 
 #include "ast.h"
 #include "lexer.h"
 
-const uint8_t *src_base;
+static inline TokKind
+peek_kind(Parser *parser) {
+  return parser->toks->kinds[parser->cur];
+}
 
-static Expr *
-make_expr(AST *ast, int t, SourcePosition pos) {
-  Expr *ret = mempool_alloc(&ast->pool, sizeof(Expr));
-  ret->t = t;
-  ret->pos = pos;
-  ret->type = NULL;
-  return ret;
+/* returns the index of the consumed token, TOK_EOF is never consumed */
+static inline size_t
+next_tok(Parser *parser) {
+  size_t idx = parser->cur;
+  if (parser->toks->kinds[idx] != TOK_EOF) {
+    parser->cur++;
+  }
+  return idx;
+}
+
+static inline TokKind
+tok_kind(Parser *parser, size_t idx) {
+  return parser->toks->kinds[idx];
+}
+
+static inline SourcePosition
+tok_pos(Parser *parser, size_t idx) {
+  return token_pos(parser->toks, idx);
+}
+
+static inline Atom
+tok_atom(Parser *parser, size_t idx) {
+  return parser->toks->atoms[idx];
+}
+
+/* An expression while its function is being parsed, split into the arrays
+ * of an ExprTable afterwards */
+typedef struct {
+  uint8_t kind;
+  uint8_t sub;
+  uint32_t a;
+  uint32_t b;
+  uint32_t pos_off;
+  uint32_t pos_len;
+} ExprNode;
+
+static ExprId
+make_expr(Parser *parser, int t, SourcePosition pos) {
+  ExprId id = parser->nodes.items;
+  ExprNode *node = vector_alloc(&parser->nodes);
+  node->kind = t;
+  node->sub = 0;
+  node->a = 0;
+  node->b = 0;
+  node->pos_off = pos.start - parser->file->src;
+  node->pos_len = pos.sz;
+  return id;
+}
+
+static inline ExprNode *
+expr_node(Parser *parser, ExprId id) {
+  return (ExprNode *)parser->nodes.data + id;
+}
+
+static SourcePosition
+node_pos(Parser *parser, ExprId id) {
+  ExprNode *node = expr_node(parser, id);
+  SourcePosition pos = {parser->file->src + node->pos_off, node->pos_len};
+  return pos;
+}
+
+static ExprId
+make_binop(Parser *parser, int op, ExprId left, ExprId right) {
+  SourcePosition pos =
+      combine_pos(node_pos(parser, left), node_pos(parser, right));
+  ExprId id = make_expr(parser, EXPR_BINOP, pos);
+  ExprNode *node = expr_node(parser, id);
+  node->sub = op;
+  node->a = left;
+  node->b = right;
+  return id;
 }
 
-static Token
-expect(TokKind t, const char *err_msg) {
-  Token ret = lexer_next();
-  if (ret.t != t) {
-    log_source_err(err_msg, src_base, ret.pos);
+static size_t
+expect(Parser *parser, TokKind t, const char *err_msg) {
+  size_t ret = next_tok(parser);
+  if (tok_kind(parser, ret) != t) {
+    log_source_err(err_msg, parser->file->src, tok_pos(parser, ret));
   }
   return ret;
 }
 
-static Expr *parse_expr(AST *ast);
-
 static const size_t intlit_pos_sz[] = {
     [INTLIT_U8] = 2,  [INTLIT_I8] = 2,  [INTLIT_U16] = 3,
     [INTLIT_I16] = 3, [INTLIT_U32] = 3, [INTLIT_I32] = 3,
     [INTLIT_U64] = 3, [INTLIT_I64] = 3, [INTLIT_I64_NONE] = 0};
 
+/* returns 1 if the number doesn't fit in 64 bits */
 static int
 pos_to_num(SourcePosition pos, uint64_t *ret) {
   for (size_t i = 0; i < pos.sz; i++) {
-    if (!__builtin_add_overflow(*ret, pos.start[i] - '0', ret)) {
-      return 0;
+    if (__builtin_mul_overflow(*ret, 10, ret) ||
+        __builtin_add_overflow(*ret, pos.start[i] - '0', ret)) {
+      return 1;
     }
   }
-  return 1;
+  return 0;
 }
 
-static inline Expr *
-make_intlit_expr(AST *ast, SourcePosition whole_pos, int t) {
-  Expr *ret = make_expr(ast, EXPR_INT, whole_pos);
-  whole_pos.sz -= intlit_pos_sz[t];
-  if (pos_to_num(whole_pos, &ret->data.intlit.val)) {
-    whole_pos.sz += intlit_pos_sz[t];
-    log_source_err("overflow on '%.*s'", ast->src_base, whole_pos,
+static inline ExprId
+make_intlit_expr(Parser *parser, SourcePosition whole_pos, int t) {
+  uint64_t val = 0;
+  SourcePosition digits = whole_pos;
+  digits.sz -= intlit_pos_sz[t];
+  if (pos_to_num(digits, &val)) {
+    log_source_err("overflow on '%.*s'", parser->file->src, whole_pos,
                    (int)whole_pos.sz, (char *)whole_pos.start);
   }
-  ret->data.intlit.type = t;
-  return ret;
+  ExprId id = make_expr(parser, EXPR_INT, whole_pos);
+  ExprNode *node = expr_node(parser, id);
+  node->a = (uint32_t)val;
+  node->b = (uint32_t)(val >> 32);
+  node->sub = t;
+  return id;
 }
 
-static Expr *
-parse_funcall(AST *ast, Token name_tok) {
-  lexer_next();
-  Vector args;
-  vector_init(&args, sizeof(Expr *), &ast->pool);
-  while (lexer_peek().t != TOK_RPAREN) {
-    Expr *temp = parse_expr(ast);
-    vector_push(&args, &temp);
-    if (lexer_peek().t != TOK_COMMA) {
-      break;
-    }
-    lexer_next();
-  }
-  Token last_paren = expect(TOK_RPAREN, "expected ')'");
-  Expr *ret =
-      make_expr(ast, EXPR_FUNCALL, combine_pos(name_tok.pos, last_paren.pos));
-  ret->data.funcall.args = args;
-  ret->data.funcall.name = name_tok.pos;
-  return ret;
+/* Builds a call once its arguments are in parser->args */
+static ExprId
+finish_call(Parser *parser, size_t name_tok, size_t args_start) {
+  size_t last_paren = expect(parser, TOK_RPAREN, "expected ')'");
+
+  uint32_t nargs = parser->args.items - args_start;
+  uint32_t extra = parser->extra.items;
+  uint32_t header[3] = {tok_atom(parser, name_tok),
+                        tok_pos(parser, name_tok).sz, nargs};
+  vector_reserve(&parser->extra, extra + 3 + nargs);
+  memcpy((uint32_t *)parser->extra.data + extra, header, sizeof(header));
+  memcpy((uint32_t *)parser->extra.data + extra + 3,
+         (ExprId *)parser->args.data + args_start, sizeof(ExprId) * nargs);
+  parser->extra.items += 3 + nargs;
+  parser->args.items = args_start;
+
+  ExprId id = make_expr(
+      parser, EXPR_FUNCALL,
+      combine_pos(tok_pos(parser, name_tok), tok_pos(parser, last_paren)));
+  ExprNode *node = expr_node(parser, id);
+  node->a = extra;
+  node->b = parser->nentries++;
+  return id;
+}
+
+typedef enum {
+  FRAME_BINOP, /* operator waiting for its right operand */
+  FRAME_PAREN,
+  FRAME_CALL, /* call waiting for its next argument */
+} FrameKind;
+
+/* Entry of the work stack of parse_expr */
+typedef struct {
+  uint8_t kind;
+  uint8_t op; /* BinopKind */
+  uint8_t prec;
+  ExprId left;       /* FRAME_BINOP */
+  size_t tok;        /* name of the function of a FRAME_CALL */
+  size_t args_start; /* FRAME_CALL */
+} ExprFrame;
+
+static ExprFrame *
+push_frame(Parser *parser, FrameKind kind, size_t tok) {
+  ExprFrame *frame = vector_alloc(&parser->frames);
+  frame->kind = kind;
+  frame->tok = tok;
+  return frame;
 }
 
-static Expr *
-parse_primary(AST *ast) {
-  Token tok = lexer_next();
-  switch (tok.t) {
+/* Parses a literal or a variable.  Opening parentheses and calls are pushed
+ * on the work stack instead, and EXPR_NONE is returned. */
+static ExprId
+parse_operand(Parser *parser) {
+  size_t tok = next_tok(parser);
+  switch (tok_kind(parser, tok)) {
     case TOK_INT:
-      return make_intlit_expr(ast, tok.pos, tok.intlit_type);
+      return make_intlit_expr(parser, tok_pos(parser, tok),
+                              parser->toks->intlit_types[tok]);
     case TOK_SYM:
-      if (lexer_peek().t == TOK_LPAREN) {
-        return parse_funcall(ast, tok);
+      if (peek_kind(parser) == TOK_LPAREN) {
+        next_tok(parser);
+        if (peek_kind(parser) == TOK_RPAREN) {
+          return finish_call(parser, tok, parser->args.items);
+        }
+        push_frame(parser, FRAME_CALL, tok)->args_start = parser->args.items;
+        return EXPR_NONE;
       }
-      return make_expr(ast, EXPR_VAR, tok.pos);
-    case TOK_LPAREN:
       {
-        Expr *ret = parse_expr(ast);
-        expect(TOK_RPAREN, "expected ')'");
-        return ret;
+        ExprId id = make_expr(parser, EXPR_VAR, tok_pos(parser, tok));
+        ExprNode *node = expr_node(parser, id);
+        node->a = tok_atom(parser, tok);
+        node->b = parser->nentries++;
+        return id;
       }
+    case TOK_LPAREN:
+      push_frame(parser, FRAME_PAREN, tok);
+      return EXPR_NONE;
     default:
-      log_source_err("expected expression", src_base, tok.pos);
-      return NULL; /* unreachable */
+      log_source_err("expected expression", parser->file->src,
+                     tok_pos(parser, tok));
+      return EXPR_NONE; /* unreachable */
   }
 }
 
-static int
-parse_binop() {
-  Token tok = lexer_next();
-  switch (tok.t) {
-    case TOK_ADD:
-      return BINOP_ADD;
-    case TOK_SUB:
-      return BINOP_SUB;
-    case TOK_MUL:
-      return BINOP_MUL;
-    case TOK_DIV:
-      return BINOP_DIV;
-    case TOK_DEQ:
-      return BINOP_EQ;
-    case TOK_NEQ:
-      return BINOP_NEQ;
-    case TOK_GR:
-      return BINOP_GR;
-    case TOK_LE:
-      return BINOP_LE;
-    case TOK_GREQ:
-      return BINOP_GREQ;
-    case TOK_LEEQ:
-      return BINOP_LEEQ;
-    default:
-      log_internal_err("impossible binary op token %d", tok.t);
-      exit(EXIT_FAILURE);
+/* Binding power of the binary operators, higher binds tighter.  0 is kept
+ * for tokens that are not binary operators. */
+enum {
+  PREC_NONE,
+  PREC_COMP,
+  PREC_TERM,
+  PREC_FACTOR,
+};
+
+typedef struct {
+  uint8_t prec;
+  uint8_t op; /* BinopKind */
+  uint8_t right_assoc;
+} BinopInfo;
+
+/* indexed by TokKind, a new operator only needs a row here */
+static const BinopInfo binop_tbl[] = {
+    [TOK_MUL] = {PREC_FACTOR, BINOP_MUL, 0},
+    [TOK_DIV] = {PREC_FACTOR, BINOP_DIV, 0},
+    [TOK_ADD] = {PREC_TERM, BINOP_ADD, 0},
+    [TOK_SUB] = {PREC_TERM, BINOP_SUB, 0},
+    [TOK_DEQ] = {PREC_COMP, BINOP_EQ, 0},
+    [TOK_NEQ] = {PREC_COMP, BINOP_NEQ, 0},
+    [TOK_GR] = {PREC_COMP, BINOP_GR, 0},
+    [TOK_LE] = {PREC_COMP, BINOP_LE, 0},
+    [TOK_GREQ] = {PREC_COMP, BINOP_GREQ, 0},
+    [TOK_LEEQ] = {PREC_COMP, BINOP_LEEQ, 0},
+};
+
+static inline BinopInfo
+binop_info(TokKind t) {
+  static const BinopInfo none = {PREC_NONE, 0, 0};
+  if ((size_t)t >= sizeof(binop_tbl) / sizeof(*binop_tbl)) {
+    return none;
   }
+  return binop_tbl[t];
 }
 
-static Expr *
-parse_factor(AST *ast) {
-  Expr *ret = parse_primary(ast);
-  Token tok;
-  while ((tok = lexer_peek()).t == TOK_MUL || tok.t == TOK_DIV) {
-    int op = parse_binop();
-    Expr *right = parse_primary(ast);
-    Expr *new_ret =
-        make_expr(ast, EXPR_BINOP, combine_pos(ret->pos, right->pos));
-    new_ret->data.binop.left = ret;
-    new_ret->data.binop.right = right;
-    new_ret->data.binop.op = op;
-    ret = new_ret;
+/* Pops the operators on top of the work stack that bind at least as tight
+ * as min_prec, right is the right operand of the topmost one */
+static ExprId
+reduce_binops(Parser *parser, ExprId right, int min_prec) {
+  Vector *frames = &parser->frames;
+  while (frames->items > 0) {
+    ExprFrame *top = (ExprFrame *)frames->data + frames->items - 1;
+    if (top->kind != FRAME_BINOP || top->prec < min_prec) {
+      break;
+    }
+    right = make_binop(parser, top->op, top->left, right);
+    frames->items--;
   }
-  return ret;
+  return right;
 }
 
-static Expr *
-parse_term(AST *ast) {
-  Expr *ret = parse_factor(ast);
-  Token tok;
-  while ((tok = lexer_peek()).t == TOK_ADD || tok.t == TOK_SUB) {
-    int op = parse_binop();
-    Expr *right = parse_factor(ast);
-    Expr *new_ret =
-        make_expr(ast, EXPR_BINOP, combine_pos(ret->pos, right->pos));
-    new_ret->data.binop.left = ret;
-    new_ret->data.binop.right = right;
-    new_ret->data.binop.op = op;
-    ret = new_ret;
-  }
-  return ret;
-}
+/* Operator precedence parsing over binop_tbl.  Operators waiting for their
+ * right operand, open parentheses and calls are kept on a work stack in the
+ * scratch pool instead of the C stack, so how deeply an expression nests is
+ * only bounded by memory.  Nodes are still made in evaluation order. */
+static ExprId
+parse_expr(Parser *parser) {
+  Vector *frames = &parser->frames;
+  while (1) {
+    ExprId operand;
+    do {
+      operand = parse_operand(parser);
+    } while (operand == EXPR_NONE);
+
+    /* operators and closing parentheses after the operand */
+    while (1) {
+      BinopInfo info = binop_info(peek_kind(parser));
+      if (info.prec != PREC_NONE) {
+        next_tok(parser);
+        int min_prec = info.right_assoc ? info.prec + 1 : info.prec;
+        ExprId left = reduce_binops(parser, operand, min_prec);
+        ExprFrame *frame = push_frame(parser, FRAME_BINOP, 0);
+        frame->op = info.op;
+        frame->prec = info.prec;
+        frame->left = left;
+        break;
+      }
 
-static Expr *
-parse_comp(AST *ast) {
-  Expr *ret = parse_term(ast);
-  Token tok;
-  while ((tok = lexer_peek()).t == TOK_DEQ || tok.t == TOK_NEQ ||
-         tok.t == TOK_GR || tok.t == TOK_LE || tok.t == TOK_GREQ ||
-         tok.t == TOK_LEEQ) {
-    int op = parse_binop();
-    Expr *right = parse_term(ast);
-    Expr *new_ret =
-        make_expr(ast, EXPR_BINOP, combine_pos(ret->pos, right->pos));
-    new_ret->data.binop.left = ret;
-    new_ret->data.binop.right = right;
-    new_ret->data.binop.op = op;
-    ret = new_ret;
-  }
-  return ret;
-}
+      operand = reduce_binops(parser, operand, PREC_COMP);
+      if (frames->items == 0) {
+        return operand;
+      }
+      ExprFrame top = ((ExprFrame *)frames->data)[frames->items - 1];
+      if (top.kind == FRAME_PAREN) {
+        expect(parser, TOK_RPAREN, "expected ')'");
+        frames->items--;
+        continue;
+      }
 
-static inline Expr *
-parse_expr(AST *ast) {
-  return parse_comp(ast);
+      vector_push(&parser->args, &operand);
+      if (peek_kind(parser) == TOK_COMMA) {
+        next_tok(parser);
+        if (peek_kind(parser) != TOK_RPAREN) {
+          break;
+        }
+      }
+      frames->items--;
+      operand = finish_call(parser, top.tok, top.args_start);
+    }
+  }
 }
 
 static Type *
-parse_type(AST *ast) {
-  (void)ast; /* will need this later for allocations */
-  Token type_tok = lexer_next();
-  switch (type_tok.t) {
+parse_type(Parser *parser) {
+  size_t type_tok = next_tok(parser);
+  switch (tok_kind(parser, type_tok)) {
     case TOK_U8:
       return &U8_const;
     case TOK_U16:
@@ -211,130 +338,205 @@ parse_type(AST *ast) {
     case TOK_BOOL:
       return &bool_const;
     default:
-      log_source_err("expected type name", src_base, type_tok.pos);
+      log_source_err("expected type name", parser->file->src,
+                     tok_pos(parser, type_tok));
       return NULL;
   }
 }
 
 static void
-parse_let(AST *ast, Stmt *stmt, int mut) {
-  Token first_tok = lexer_next();
+parse_let(Parser *parser, Stmt *stmt, int mut) {
+  size_t first_tok = next_tok(parser);
   stmt->t = STMT_LET;
-  Token var_name = expect(TOK_SYM, "expected variable name");
+  size_t var_name = expect(parser, TOK_SYM, "expected variable name");
 
-  Token last_tok;
-  Token middle_tok = lexer_next();
-  if (middle_tok.t == TOK_EQ) {
-    stmt->data.let.value = parse_expr(ast);
+  size_t last_tok = 0;
+  size_t middle_tok = next_tok(parser);
+  if (tok_kind(parser, middle_tok) == TOK_EQ) {
+    stmt->data.let.value = parse_expr(parser);
     stmt->data.let.type = NULL;
-    last_tok = expect(TOK_NEWLINE, "expected newline or ';'");
-  } else if (middle_tok.t == TOK_COLON) {
-    stmt->data.let.type = parse_type(ast);
-    Token equal_tok = lexer_next();
-    if (equal_tok.t == TOK_EQ) {
-      stmt->data.let.value = parse_expr(ast);
-      last_tok = expect(TOK_NEWLINE, "expected newline or ';'");
-    } else if (equal_tok.t == TOK_NEWLINE) {
+    last_tok = expect(parser, TOK_NEWLINE, "expected newline or ';'");
+  } else if (tok_kind(parser, middle_tok) == TOK_COLON) {
+    stmt->data.let.type = parse_type(parser);
+    size_t equal_tok = next_tok(parser);
+    if (tok_kind(parser, equal_tok) == TOK_EQ) {
+      stmt->data.let.value = parse_expr(parser);
+      last_tok = expect(parser, TOK_NEWLINE, "expected newline or ';'");
+    } else if (tok_kind(parser, equal_tok) == TOK_NEWLINE) {
       last_tok = equal_tok;
-      stmt->data.let.value = NULL;
+      stmt->data.let.value = EXPR_NONE;
     } else {
-      log_source_err("expected '=' or ';'", src_base, equal_tok.pos);
+      log_source_err("expected '=' or ';'", parser->file->src,
+                     tok_pos(parser, equal_tok));
     }
   } else {
-    log_source_err("expected '=' or ':'", src_base, middle_tok.pos);
+    log_source_err("expected '=' or ':'", parser->file->src,
+                   tok_pos(parser, middle_tok));
   }
 
-  stmt->pos = combine_pos(first_tok.pos, last_tok.pos);
-  stmt->data.let.name = var_name.pos;
+  stmt->pos =
+      combine_pos(tok_pos(parser, first_tok), tok_pos(parser, last_tok));
+  stmt->data.let.name = tok_pos(parser, var_name);
+  stmt->data.let.atom = tok_atom(parser, var_name);
   stmt->data.let.mut = mut;
 }
 
 static void
-parse_expr_stmt(AST *ast, Stmt *stmt) {
+parse_expr_stmt(Parser *parser, Stmt *stmt) {
   stmt->t = STMT_EXPR;
-  stmt->data.expr = parse_expr(ast);
-  expect(TOK_NEWLINE, "expected newline or ';'");
+  stmt->data.expr = parse_expr(parser);
+  expect(parser, TOK_NEWLINE, "expected newline or ';'");
 }
 
 static void
-parse_return(AST *ast, Stmt *stmt) {
-  lexer_next(); /* skip 'return' */
+parse_return(Parser *parser, Stmt *stmt) {
+  next_tok(parser); /* skip 'return' */
   stmt->t = STMT_RETURN;
-  if (lexer_peek().t == TOK_NEWLINE) {
-    lexer_next();
-    stmt->data.ret = NULL;
+  if (peek_kind(parser) == TOK_NEWLINE) {
+    next_tok(parser);
+    stmt->data.ret = EXPR_NONE;
   } else {
-    stmt->data.ret = parse_expr(ast);
-    expect(TOK_NEWLINE, "expected newline or ';'");
+    stmt->data.ret = parse_expr(parser);
+    expect(parser, TOK_NEWLINE, "expected newline or ';'");
+  }
+}
+
+static void *
+copy_array(MemPool *pool, const void *src, size_t sz) {
+  void *dst = mempool_alloc(pool, sz);
+  memcpy(dst, src, sz);
+  return dst;
+}
+
+static void
+build_expr_table(Parser *parser, ExprTable *exprs) {
+  MemPool *pool = parser->pool;
+  uint32_t count = parser->nodes.items;
+  exprs->src = parser->file->src;
+  exprs->count = count;
+  exprs->kinds = mempool_alloc(pool, count);
+  exprs->subs = mempool_alloc(pool, count);
+  exprs->a = mempool_alloc(pool, sizeof(uint32_t) * count);
+  exprs->b = mempool_alloc(pool, sizeof(uint32_t) * count);
+  exprs->pos_offs = mempool_alloc(pool, sizeof(uint32_t) * count);
+  exprs->pos_lens = mempool_alloc(pool, sizeof(uint32_t) * count);
+  for (uint32_t i = 0; i < count; i++) {
+    ExprNode *node = expr_node(parser, i);
+    exprs->kinds[i] = node->kind;
+    exprs->subs[i] = node->sub;
+    exprs->a[i] = node->a;
+    exprs->b[i] = node->b;
+    exprs->pos_offs[i] = node->pos_off;
+    exprs->pos_lens[i] = node->pos_len;
   }
+
+  exprs->types = mempool_alloc(pool, sizeof(Type *) * count);
+  memset(exprs->types, 0, sizeof(Type *) * count);
+  exprs->extra = copy_array(pool, parser->extra.data,
+                            sizeof(uint32_t) * parser->extra.items);
+  size_t entries_sz = sizeof(ScopeEntry *) * parser->nentries;
+  exprs->entries = mempool_alloc(pool, entries_sz);
+  memset(exprs->entries, 0, entries_sz);
 }
 
 void
-parse_block(Block *block, AST *ast) {
-  lexer_next(); /* skip '{' */
-  vector_init(&block->stmts, sizeof(Stmt), &ast->pool);
+parse_block(Block *block, Parser *parser) {
+  next_tok(parser); /* skip '{' */
+  vector_init(&block->stmts, sizeof(Stmt), parser->pool);
   while (1) {
-    switch (lexer_peek().t) {
+    switch (peek_kind(parser)) {
       case TOK_LET:
-        parse_let(ast, vector_alloc(&block->stmts), 0);
+        parse_let(parser, vector_alloc(&block->stmts), 0);
         break;
       case TOK_RETURN:
-        parse_return(ast, vector_alloc(&block->stmts));
+        parse_return(parser, vector_alloc(&block->stmts));
         break;
       case TOK_MUT:
-        parse_let(ast, vector_alloc(&block->stmts), 1);
+        parse_let(parser, vector_alloc(&block->stmts), 1);
         break;
       /* TODO: Replace this with '}' for proper blocks */
       case TOK_RCURLY:
-        lexer_next();
+        next_tok(parser);
+        vector_freeze(&block->stmts);
         return;
       default:
-        parse_expr_stmt(ast, vector_alloc(&block->stmts));
+        parse_expr_stmt(parser, vector_alloc(&block->stmts));
         break;
     }
   }
 }
 
 void
-parse_fn(AST *ast, Function *function) {
-  Token name_tok = expect(TOK_SYM, "expected function name");
-  function->name = name_tok.pos;
-  function->pos = name_tok.pos;
-
-  expect(TOK_LPAREN, "expected '('");
-  vector_init(&function->params, sizeof(Param), &ast->pool);
-
-  while (lexer_peek().t != TOK_RPAREN) {
+parse_fn_sig(Parser *parser, Function *function) {
+  size_t name_tok = expect(parser, TOK_SYM, "expected function name");
+  function->name = tok_pos(parser, name_tok);
+  function->pos = tok_pos(parser, name_tok);
+  function->atom = tok_atom(parser, name_tok);
+  function->toks = parser->toks;
+  function->tok_start = name_tok;
+  function->cached = 0;
+
+  expect(parser, TOK_LPAREN, "expected '('");
+  vector_init(&function->params, sizeof(Param), parser->pool);
+
+  while (peek_kind(parser) != TOK_RPAREN) {
     Param *param = vector_alloc(&function->params);
-    Token name_tok = expect(TOK_SYM, "expected param name");
-    param->name = name_tok.pos;
+    size_t name_tok = expect(parser, TOK_SYM, "expected param name");
+    param->name = tok_pos(parser, name_tok);
+    param->atom = tok_atom(parser, name_tok);
 
-    param->type = parse_type(ast);
-    if (lexer_peek().t == TOK_COMMA) {
-      lexer_next();
+    param->type = parse_type(parser);
+    if (peek_kind(parser) == TOK_COMMA) {
+      next_tok(parser);
     }
   }
-  lexer_next(); /* skip ')' */
+  next_tok(parser); /* skip ')' */
+  vector_freeze(&function->params);
 
   function->ret_type = &void_const;
-  if (lexer_peek().t != TOK_LCURLY) {
-    function->ret_type = parse_type(ast);
+  if (peek_kind(parser) != TOK_LCURLY) {
+    function->ret_type = parse_type(parser);
   }
+}
 
-  parse_block(&function->body, ast);
+void
+parse_fn(Parser *parser, Function *function) {
+  parse_fn_sig(parser, function);
+
+  MemPoolMark mark = mempool_mark(parser->scratch);
+  vector_init(&parser->nodes, sizeof(ExprNode), parser->scratch);
+  vector_init(&parser->extra, sizeof(uint32_t), parser->scratch);
+  vector_init(&parser->args, sizeof(ExprId), parser->scratch);
+  vector_init(&parser->frames, sizeof(ExprFrame), parser->scratch);
+  parser->nentries = 0;
+  vector_alloc(&parser->nodes); /* EXPR_NONE */
+
+  parse_block(&function->body, parser);
+  function->tok_end = parser->cur;
+  build_expr_table(parser, &function->exprs);
+  mempool_release(parser->scratch, mark);
 }
 
-AST
-parse_ast(const uint8_t *src) {
-  AST ret;
+void
+parser_init(Parser *parser, SourceFile *file, MemPool *pool,
+            MemPool *scratch) {
+  vector_init(&file->fns, sizeof(Function), pool);
+  parser_init_tokens(parser, file, &file->tokens, pool, scratch);
+}
 
-  ast_init(&ret, src);
-  ast_init(&ret, src);
+void
+parser_init_tokens(Parser *parser, SourceFile *file, const TokenBuffer *toks,
+                   MemPool *pool, MemPool *scratch) {
+  parser->file = file;
+  parser->pool = pool;
+  parser->scratch = scratch;
+  parser->toks = toks;
+  parser->cur = 0;
+}
 
-  while (lexer_peek().t != TOK_EOF) {
-    parse_fn(&ret, vector_alloc(&ret.fns));
+void
+parse_ast(Parser *parser) {
+  while (peek_kind(parser) != TOK_EOF) {
+    parse_fn(parser, vector_alloc(&parser->file->fns));
   }
-
-  src_base = src;
-  return ret;
 }
@@ -0,0 +1,218 @@
+#include "semantics.h"
+
+#include "jobs.h"
+
+Type *
+coerce_type(int op, Type **_left, Type **_right, MemPool *pool) {
+  Type *left = *_left;
+  Type *right = *_right;
+  (void)pool;
+  switch (op) {
+    case BINOP_ADD:
+    case BINOP_SUB:
+    case BINOP_MUL:
+    case BINOP_DIV:
+    case BINOP_ASSIGN:
+      if (left->t != right->t) {
+        return NULL;
+      }
+      return left;
+    case BINOP_NEQ:
+    case BINOP_EQ:
+    case BINOP_GR:
+    case BINOP_GREQ:
+    case BINOP_LE:
+    case BINOP_LEEQ:
+      if (left->t != right->t) {
+        return NULL;
+      }
+      return &bool_const;
+    default:
+      log_internal_err("invalid binary op %d", op);
+      return NULL;
+  }
+}
+
+static Type *intlit_type_to_type[] = {&I8_const,  &U8_const,  &I16_const,
+                                      &U16_const, &I32_const, &U32_const,
+                                      &I64_const, &U64_const, &I64_const};
+
+static ScopeEntry *
+find_entry(Scope *scope, ExprTable *exprs, ExprId expr, Atom atom,
+           SourcePosition name, const char *what) {
+  ScopeEntry *entry = scope_find(scope, atom);
+  if (entry == NULL) {
+    log_source_err("cannot find %s '%.*s'", exprs->src, name, what,
+                   (int)name.sz, (char *)name.start);
+  }
+  *expr_entry(exprs, expr) = entry;
+  return entry;
+}
+
+static void
+check_call(Scope *scope, ExprTable *exprs, ExprId expr, MemPool *pool) {
+  ScopeEntry *entry =
+      find_entry(scope, exprs, expr, expr_call_atom(exprs, expr),
+                 expr_call_name(exprs, expr), "function");
+  SourcePosition pos = expr_pos(exprs, expr);
+  Type *fn_type = entry->inf.type;
+  if (fn_type->t != TYPE_FN) {
+    log_source_err("cannot call a non-function value", exprs->src, pos);
+  }
+  uint32_t nargs = expr_call_nargs(exprs, expr);
+  if (fn_type->data.fn.args.items != nargs) {
+    log_source_err("too %s parameters given in function call", exprs->src,
+                   pos, fn_type->data.fn.args.items > nargs ? "few" : "many");
+  }
+  const ExprId *args = expr_call_args(exprs, expr);
+  for (size_t i = 0; i < nargs; i++) {
+    Type **expected = vector_idx(&fn_type->data.fn.args, i);
+    Type **given = &exprs->types[args[i]];
+    if (coerce_type(BINOP_ASSIGN, expected, given, pool) == NULL) {
+      log_source_err("cannot coerce parameter", exprs->src,
+                     expr_pos(exprs, args[i]));
+    }
+  }
+  exprs->types[expr] = fn_type->data.fn.ret;
+}
+
+/* Resolves the names and types of the nodes first..last, which are the
+ * expression of a statement.  The operands of a node come before it, so
+ * they are always done by the time the node is reached. */
+static void
+check_exprs(Scope *scope, ExprTable *exprs, ExprId first, ExprId last,
+            MemPool *pool) {
+  for (ExprId expr = first; expr <= last; expr++) {
+    switch (expr_kind(exprs, expr)) {
+      case EXPR_INT:
+        exprs->types[expr] = intlit_type_to_type[exprs->subs[expr]];
+        break;
+      case EXPR_VAR:
+        {
+          ScopeEntry *entry = find_entry(scope, exprs, expr, exprs->a[expr],
+                                         expr_pos(exprs, expr), "variable");
+          exprs->types[expr] = entry->inf.type;
+          break;
+        }
+      case EXPR_BINOP:
+        exprs->types[expr] =
+            coerce_type(exprs->subs[expr], &exprs->types[exprs->a[expr]],
+                        &exprs->types[exprs->b[expr]], pool);
+        if (exprs->types[expr] == NULL) {
+          log_source_err("cannot coerce types", exprs->src,
+                         expr_pos(exprs, expr));
+        }
+        break;
+      case EXPR_FUNCALL:
+        check_call(scope, exprs, expr, pool);
+        break;
+      default:
+        log_internal_err("invalid expr type %d", expr_kind(exprs, expr));
+    }
+  }
+}
+
+static void
+check_let(AST *ast, Function *fn, Stmt *stmt, ExprId first, MemPool *pool) {
+  ScopeEntry *entry = scope_insert(
+      pool, fn->scope, stmt->data.let.atom, stmt->data.let.name,
+      make_var_info(stmt->data.let.mut, stmt->data.let.type));
+  if (entry == NULL) {
+    log_source_err("cannot redeclare variable '%.*s'",
+                   ast_src_base(ast, stmt->pos), stmt->pos,
+                   (int)stmt->data.let.name.sz,
+                   (char *)stmt->data.let.name.start);
+  }
+  stmt->data.let.var = entry;
+
+  ExprId value = stmt->data.let.value;
+  if (value == EXPR_NONE) {
+    return;
+  }
+  check_exprs(fn->scope, &fn->exprs, first, value, pool);
+  /* is this an inferred assignment? */
+  if (!stmt->data.let.type) {
+    stmt->data.let.type = fn->exprs.types[value];
+    entry->inf.type = fn->exprs.types[value]; /* set the symbol table */
+  } else if (coerce_type(BINOP_ASSIGN, &fn->exprs.types[value],
+                         &stmt->data.let.type, pool) == NULL) {
+    log_source_err("cannot coerce assignment", ast_src_base(ast, stmt->pos),
+                   stmt->pos);
+  }
+}
+
+/* only the first return of a function is checked */
+static void
+check_return(AST *ast, Function *fn, Stmt *stmt) {
+  int right;
+  if (stmt->data.ret == EXPR_NONE) {
+    right = fn->ret_type->t == TYPE_VOID;
+  } else {
+    right = coerce_type(BINOP_ASSIGN, &fn->ret_type,
+                        &fn->exprs.types[stmt->data.ret], ast->pool) != NULL;
+  }
+  if (!right) {
+    log_source_err("function returns incorrect type",
+                   ast_src_base(ast, fn->pos), fn->pos);
+  }
+}
+
+/* Resolves names, assigns types and checks the returns of fn in one walk over
+ * its statements */
+void
+check_fn(AST *ast, Function *fn, MemPool *pool) {
+  fn->scope = scope_init(pool, ast->global);
+  for (size_t i = 0; i < fn->params.items; i++) {
+    Param *param = vector_idx(&fn->params, i);
+    param->entry = scope_insert(pool, fn->scope, param->atom, param->name,
+                                make_var_info(0, param->type));
+  }
+
+  int returned = 0;
+  ExprId first = EXPR_NONE + 1;
+  for (size_t i = 0; i < fn->body.stmts.items; i++) {
+    Stmt *stmt = vector_idx(&fn->body.stmts, i);
+    switch (stmt->t) {
+      case STMT_LET:
+        check_let(ast, fn, stmt, first, pool);
+        break;
+      case STMT_EXPR:
+        check_exprs(fn->scope, &fn->exprs, first, stmt->data.expr, pool);
+        break;
+      case STMT_RETURN:
+        if (stmt->data.ret != EXPR_NONE) {
+          check_exprs(fn->scope, &fn->exprs, first, stmt->data.ret, pool);
+        }
+        if (!returned) {
+          check_return(ast, fn, stmt);
+          returned = 1;
+        }
+        break;
+      default:
+        log_internal_err("invalid stmt type %d", stmt->t);
+    }
+    if (stmt_expr(stmt) != EXPR_NONE) {
+      first = stmt_expr(stmt) + 1;
+    }
+  }
+
+  if (!returned && fn->ret_type->t != TYPE_VOID) {
+    log_source_err("non-void function never returns",
+                   ast_src_base(ast, fn->pos), fn->pos);
+  }
+}
+
+static void
+check_fn_job(void *ctx, size_t idx, size_t worker) {
+  AST *ast = ctx;
+  Function *fn = vector_idx(&ast->fns, idx);
+  if (!fn->cached) {
+    check_fn(ast, fn, &ast->worker_pools[worker]);
+  }
+}
+
+void
+check_fns(AST *ast) {
+  /* only reads the global scope */
+  parallel_for(&ast->jobs, ast->fns.items, check_fn_job, ast);
+}
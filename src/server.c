@@ -0,0 +1,252 @@
+#define _GNU_SOURCE
+#include "server.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "bcc2.h"
+#include "helper.h"
+#include "ssa.h"
+
+/* Everything one compile needs.  Contexts are kept after their client leaves,
+ * so later requests reuse pools whose pages are already committed. */
+typedef struct CompileCtx {
+  Bcc2Compiler cc;
+  struct CompileCtx *next; /* in the idle list */
+} CompileCtx;
+
+typedef struct {
+  size_t nworkers;
+  pthread_mutex_t lock;
+  CompileCtx *idle;
+  MemPool pool; /* holds the contexts */
+} Server;
+
+typedef struct {
+  Server *server;
+  int fd;
+} Client;
+
+static CompileCtx *
+take_ctx(Server *server) {
+  pthread_mutex_lock(&server->lock);
+  CompileCtx *ctx = server->idle;
+  if (ctx != NULL) {
+    server->idle = ctx->next;
+    pthread_mutex_unlock(&server->lock);
+    return ctx;
+  }
+  ctx = mempool_alloc(&server->pool, sizeof(CompileCtx));
+  pthread_mutex_unlock(&server->lock);
+
+  bcc2_init(&ctx->cc, server->nworkers);
+  return ctx;
+}
+
+static void
+give_ctx(Server *server, CompileCtx *ctx) {
+  pthread_mutex_lock(&server->lock);
+  ctx->next = server->idle;
+  server->idle = ctx;
+  pthread_mutex_unlock(&server->lock);
+}
+
+static int
+send_all(int fd, const void *data, size_t sz) {
+  const uint8_t *p = data;
+  while (sz > 0) {
+    ssize_t n = send(fd, p, sz, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return 0;
+    }
+    p += n;
+    sz -= n;
+  }
+  return 1;
+}
+
+/* returns NULL and fills sink if the file cannot be mapped */
+static const uint8_t *
+try_map_file(const char *path, size_t *sz, DiagSink *sink) {
+  DiagSink *prev = diag_sink_set(sink);
+  if (setjmp(sink->env) != 0) {
+    diag_sink_set(prev);
+    return NULL;
+  }
+  const uint8_t *src = map_file(path, sz);
+  diag_sink_set(prev);
+  return src;
+}
+
+/* reads and throws away the next sz bytes, returns 0 if the client left */
+static int
+skip_bytes(FILE *in, size_t sz) {
+  char buf[4096];
+  while (sz > 0) {
+    size_t n = fread(buf, 1, sz < sizeof(buf) ? sz : sizeof(buf), in);
+    if (n == 0) {
+      return 0;
+    }
+    sz -= n;
+  }
+  return 1;
+}
+
+/* returns 0 once the client should be dropped */
+static int
+handle_request(CompileCtx *ctx, FILE *in, int fd, char *line) {
+  const char *path = "-";
+  const uint8_t *src = NULL;
+  size_t sz = 0;
+  int mapped = 0;
+  char *buf = NULL;
+  DiagSink sink;
+
+  line[strcspn(line, "\n")] = '\0';
+  if (strncmp(line, "file ", 5) == 0) {
+    path = line + 5;
+    src = try_map_file(path, &sz, &sink);
+    mapped = src != NULL;
+  } else if (strncmp(line, "source ", 7) == 0) {
+    char *end;
+    sz = strtoull(line + 7, &end, 10);
+    if (*end != '\0') {
+      return 0;
+    }
+    if (sz <= SERVER_MAX_SOURCE_SZ) {
+      buf = malloc(sz);
+    }
+    if (buf == NULL) {
+      /* the source is still read so that the next request can be parsed */
+      if (!skip_bytes(in, sz)) {
+        return 0;
+      }
+      sink.diag = (Diagnostic){.kind = DIAG_ERROR};
+      snprintf(sink.diag.msg, sizeof(sink.diag.msg),
+               sz > SERVER_MAX_SOURCE_SZ ? "source is larger than %zu bytes"
+                                         : "out of memory",
+               (size_t)SERVER_MAX_SOURCE_SZ);
+    } else if (fread(buf, 1, sz, in) != sz) {
+      free(buf);
+      return 0;
+    }
+    src = (uint8_t *)buf;
+  } else {
+    return 0;
+  }
+
+  char *text = NULL;
+  size_t text_sz = 0;
+  int ok = 0;
+  if (src != NULL) {
+    Bcc2Source source = {.path = path, .src = src, .sz = sz};
+    SSA_Prog *prog = bcc2_compile(&ctx->cc, &source, 1, &sink.diag);
+    if (prog != NULL) {
+      FILE *out = open_memstream(&text, &text_sz);
+      ssa_prog_dump(out, prog, 0);
+      fclose(out);
+      ok = 1;
+    }
+  }
+  if (mapped) {
+    munmap((uint8_t *)src, sz);
+  }
+  free(buf);
+
+  int sent;
+  if (ok) {
+    char header[32];
+    int header_sz = snprintf(header, sizeof(header), "ok %zu\n", text_sz);
+    sent = send_all(fd, header, header_sz) && send_all(fd, text, text_sz);
+  } else {
+    char *reply;
+    int reply_sz =
+        asprintf(&reply, "error %s:%zu:%zu: %s%s\n", path, sink.diag.line,
+                 sink.diag.column,
+                 sink.diag.kind == DIAG_INTERNAL ? "internal error: " : "",
+                 sink.diag.msg);
+    sent = reply_sz >= 0 && send_all(fd, reply, reply_sz);
+    free(reply);
+  }
+  free(text);
+  return sent;
+}
+
+static void *
+client_main(void *arg) {
+  Client *client = arg;
+  CompileCtx *ctx = take_ctx(client->server);
+  FILE *in = fdopen(client->fd, "r");
+
+  char *line = NULL;
+  size_t line_cap = 0;
+  while (getline(&line, &line_cap, in) > 0 &&
+         handle_request(ctx, in, client->fd, line)) {
+  }
+
+  free(line);
+  fclose(in);
+  give_ctx(client->server, ctx);
+  free(client);
+  return NULL;
+}
+
+void
+run_server(const char *socket_path, size_t nworkers) {
+  Server server = {.nworkers = nworkers, .idle = NULL};
+  pthread_mutex_init(&server.lock, NULL);
+  mempool_init(&server.pool);
+
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    log_err_final("socket path '%s' is too long", socket_path);
+  }
+  strcpy(addr.sun_path, socket_path);
+
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd == -1) {
+    log_err_final("unable to create socket");
+  }
+  /* a socket left behind by an earlier server, anything else is the user's */
+  struct stat st;
+  if (lstat(socket_path, &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      log_err_final("'%s' exists and is not a socket", socket_path);
+    }
+    unlink(socket_path);
+  }
+  if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+      listen(listen_fd, 64) == -1) {
+    log_err_final("unable to listen on '%s'", socket_path);
+  }
+
+  while (1) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd == -1) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      log_err_final("unable to accept connections on '%s'", socket_path);
+    }
+
+    Client *client = malloc(sizeof(Client));
+    client->server = &server;
+    client->fd = fd;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, client_main, client) != 0) {
+      log_err("unable to start a thread for a client");
+      close(fd);
+      free(client);
+      continue;
+    }
+    pthread_detach(thread);
+  }
+}
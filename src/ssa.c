@@ -51,8 +51,8 @@ bblock_replace_reg(SSA_BBlock *block, RegId find, RegId replacement,
     SSA_Inst *inst = vector_idx(&block->insts, i);
 
     for (uint8_t op = 0; op < inst_arity_tbl[inst->t]; op++) {
-      if (inst->data.operands[i] == find) {
-        inst->data.operands[i] = replacement;
+      if (inst->data.operands[op] == find) {
+        inst->data.operands[op] = replacement;
       }
     }
   }
@@ -66,6 +66,39 @@ ssa_new_reg(SSA_Fn *fn, int sz) {
   return ret;
 }
 
+void
+ssa_prog_init(SSA_Prog *prog, size_t nworkers) {
+  MemPool *pools = mempool_alloc_array(1 + nworkers);
+  ssa_prog_init_pools(prog, pools, nworkers);
+  prog->own_pools = pools;
+}
+
+void
+ssa_prog_init_pools(SSA_Prog *prog, MemPool *pools, size_t nworkers) {
+  prog->pool = &pools[0];
+  prog->nworkers = nworkers;
+  prog->worker_pools = &pools[1];
+  prog->own_pools = NULL;
+  prog->jobs = NULL;
+  ssa_prog_reset(prog);
+}
+
+void
+ssa_prog_reset(SSA_Prog *prog) {
+  mempool_release(prog->pool, 0);
+  for (size_t i = 0; i < prog->nworkers; i++) {
+    mempool_release(&prog->worker_pools[i], 0);
+  }
+  vector_init(&prog->fns, sizeof(SSA_Fn), prog->pool);
+}
+
+void
+ssa_prog_deinit(SSA_Prog *prog) {
+  if (prog->own_pools) {
+    mempool_free_array(prog->own_pools, 1 + prog->nworkers);
+  }
+}
+
 static const char *sz_name_tbl[] = {"", "8", "16", "32", "64"};
 
 static void
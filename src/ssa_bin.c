@@ -0,0 +1,323 @@
+#include "ssa_bin.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Points field at sz bytes allocated after everything written so far.  The
+ * pool only holds the file, so its allocations are laid out back to back. */
+static void *
+bin_alloc(MemPool *pool, SSA_BinOff *field, size_t sz) {
+  if (sz == 0) {
+    *field = 0;
+    return NULL;
+  }
+  uint8_t *data = mempool_alloc(pool, sz);
+  *field = data - (uint8_t *)field;
+  return data;
+}
+
+static void
+write_block(MemPool *pool, SSA_Prog *prog, SSA_BinBlock *bin_block,
+            SSA_BBlock *block) {
+  bin_block->ninsts = block->insts.items;
+  SSA_BinInst *insts = bin_alloc(pool, &bin_block->insts,
+                                 sizeof(SSA_BinInst) * block->insts.items);
+  for (size_t i = 0; i < block->insts.items; i++) {
+    SSA_Inst *inst = vector_idx(&block->insts, i);
+    SSA_BinInst *bin_inst = &insts[i];
+    bin_inst->t = inst->t;
+    bin_inst->sz = inst->sz;
+    bin_inst->result = inst->result;
+    switch (inst->t) {
+      case INST_IMM:
+        bin_inst->data.imm = inst->data.imm;
+        break;
+      case INST_CALLFN:
+        {
+          Vector *args = &inst->data.callfn.args;
+          bin_inst->nargs = args->items;
+          bin_inst->data.callfn.fn =
+              inst->data.callfn.fn - (SSA_Fn *)prog->fns.data;
+          RegId *bin_args = bin_alloc(pool, &bin_inst->data.callfn.args,
+                                      sizeof(RegId) * args->items);
+          if (args->items != 0) {
+            memcpy(bin_args, args->data, sizeof(RegId) * args->items);
+          }
+        }
+        break;
+      default:
+        bin_inst->data.operands[0] = inst->data.operands[0];
+        bin_inst->data.operands[1] = inst->data.operands[1];
+        break;
+    }
+  }
+}
+
+static void
+write_fn(MemPool *pool, SSA_Prog *prog, SSA_BinFn *bin_fn, SSA_Fn *fn) {
+  bin_fn->name_sz = fn->name.sz;
+  memcpy(bin_alloc(pool, &bin_fn->name, fn->name.sz), fn->name.start,
+         fn->name.sz);
+
+  bin_fn->nparams = fn->params.items;
+  RegId *params =
+      bin_alloc(pool, &bin_fn->params, sizeof(RegId) * fn->params.items);
+  if (fn->params.items != 0) {
+    memcpy(params, fn->params.data, sizeof(RegId) * fn->params.items);
+  }
+
+  bin_fn->nregs = fn->regs.items;
+  uint8_t *regs = bin_alloc(pool, &bin_fn->regs, fn->regs.items);
+  for (size_t i = 0; i < fn->regs.items; i++) {
+    regs[i] = ((SSA_Reg *)vector_idx(&fn->regs, i))->sz;
+  }
+
+  bin_fn->nblocks = 0;
+  for (SSA_BBlock *block = fn->entry; block; block = block->next) {
+    bin_fn->nblocks++;
+  }
+  SSA_BinBlock *blocks = bin_alloc(pool, &bin_fn->blocks,
+                                   sizeof(SSA_BinBlock) * bin_fn->nblocks);
+  SSA_BBlock *block = fn->entry;
+  for (size_t i = 0; i < bin_fn->nblocks; i++, block = block->next) {
+    write_block(pool, prog, &blocks[i], block);
+  }
+}
+
+void
+ssa_bin_write(const char *path, SSA_Prog *prog) {
+  MemPool pool;
+  mempool_init(&pool);
+
+  SSA_BinHeader *header = mempool_alloc(&pool, sizeof(SSA_BinHeader));
+  header->magic = SSA_BIN_MAGIC;
+  header->version = SSA_BIN_VERSION;
+  header->nfns = prog->fns.items;
+  SSA_BinFn *fns =
+      bin_alloc(&pool, &header->fns, sizeof(SSA_BinFn) * prog->fns.items);
+  for (size_t i = 0; i < prog->fns.items; i++) {
+    write_fn(&pool, prog, &fns[i], vector_idx(&prog->fns, i));
+  }
+  /* keep the size a multiple of the alignment */
+  mempool_alloc(&pool, 0);
+  header->size = mempool_stats(&pool).used;
+
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    log_err_final("unable to open '%s'", path);
+  }
+  if (fwrite(header, 1, header->size, file) != header->size ||
+      fclose(file) != 0) {
+    log_err_final("unable to write '%s'", path);
+  }
+  mempool_deinit(&pool);
+}
+
+/* checks that count items of it_sz bytes at off are inside of the file */
+static int
+in_bounds(const SSA_Bin *bin, const SSA_BinOff *off, size_t count,
+          size_t it_sz) {
+  if (count == 0) {
+    return 1;
+  }
+  int64_t start = ((const uint8_t *)off - (const uint8_t *)bin->header) + *off;
+  return start >= 0 && start % 8 == 0 && (uint64_t)start <= bin->size &&
+         count <= (bin->size - start) / it_sz;
+}
+
+/* registers are numbered from 1, 0 means none */
+static int
+reg_valid(RegId reg, uint32_t nregs) {
+  return reg != 0 && reg <= nregs;
+}
+
+/* checks the same fields of an instruction as the cache does when loading */
+static int
+inst_valid(const SSA_Bin *bin, const SSA_BinInst *inst, uint32_t nregs) {
+  if (inst->t > INST_CALLFN || inst->sz > SZ_64) {
+    return 0;
+  }
+  /* 0 if there is no result or, for an expression statement, it is unused */
+  if (inst->result > (inst_returns_tbl[inst->t] ? nregs : 0)) {
+    return 0;
+  }
+  /* a return without a value has no operand */
+  if (inst->t == INST_RET && inst->sz == SZ_NONE) {
+    return inst->data.operands[0] == 0;
+  }
+  for (int i = 0; i < inst_arity_tbl[inst->t]; i++) {
+    if (!reg_valid(inst->data.operands[i], nregs)) {
+      return 0;
+    }
+  }
+  if (inst->t == INST_CALLFN) {
+    if (inst->data.callfn.fn >= bin->header->nfns ||
+        !in_bounds(bin, &inst->data.callfn.args, inst->nargs,
+                   sizeof(RegId))) {
+      return 0;
+    }
+    const RegId *args = ssa_bin_ptr(&inst->data.callfn.args);
+    for (size_t i = 0; i < inst->nargs; i++) {
+      if (!reg_valid(args[i], nregs)) {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+static int
+validate_fn(const SSA_Bin *bin, const SSA_BinFn *fn) {
+  if (!in_bounds(bin, &fn->name, fn->name_sz, 1) ||
+      !in_bounds(bin, &fn->params, fn->nparams, sizeof(RegId)) ||
+      !in_bounds(bin, &fn->regs, fn->nregs, 1) ||
+      !in_bounds(bin, &fn->blocks, fn->nblocks, sizeof(SSA_BinBlock)) ||
+      fn->nblocks == 0) {
+    return 0;
+  }
+  const RegId *params = ssa_bin_ptr(&fn->params);
+  for (size_t i = 0; i < fn->nparams; i++) {
+    if (!reg_valid(params[i], fn->nregs)) {
+      return 0;
+    }
+  }
+  const uint8_t *regs = ssa_bin_ptr(&fn->regs);
+  for (size_t i = 0; i < fn->nregs; i++) {
+    if (regs[i] > SZ_64) {
+      return 0;
+    }
+  }
+
+  const SSA_BinBlock *blocks = ssa_bin_ptr(&fn->blocks);
+  for (size_t b = 0; b < fn->nblocks; b++) {
+    if (!in_bounds(bin, &blocks[b].insts, blocks[b].ninsts,
+                   sizeof(SSA_BinInst))) {
+      return 0;
+    }
+    const SSA_BinInst *insts = ssa_bin_ptr(&blocks[b].insts);
+    for (size_t i = 0; i < blocks[b].ninsts; i++) {
+      if (!inst_valid(bin, &insts[i], fn->nregs)) {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+void
+ssa_bin_load(SSA_Bin *bin, const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    log_err_final("unable to open '%s'", path);
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    log_err_final("unable to get stats on '%s'", path);
+  }
+  bin->size = st.st_size;
+  if (bin->size < sizeof(SSA_BinHeader)) {
+    log_err_final("'%s' is not an SSA binary", path);
+  }
+  bin->header = mmap(NULL, bin->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (bin->header == MAP_FAILED) {
+    log_err_final("unable to get contents of '%s'", path);
+  }
+  close(fd);
+
+  const SSA_BinHeader *header = bin->header;
+  if (header->magic != SSA_BIN_MAGIC) {
+    log_err_final("'%s' is not an SSA binary", path);
+  }
+  if (header->version != SSA_BIN_VERSION) {
+    log_err_final("'%s' has version %" PRIu32 ", expected %d", path,
+                  header->version, SSA_BIN_VERSION);
+  }
+  if (header->size != bin->size ||
+      !in_bounds(bin, &header->fns, header->nfns, sizeof(SSA_BinFn))) {
+    log_err_final("'%s' is truncated", path);
+  }
+  for (size_t i = 0; i < header->nfns; i++) {
+    if (!validate_fn(bin, ssa_bin_fn(bin, i))) {
+      log_err_final("'%s' is corrupt", path);
+    }
+  }
+}
+
+void
+ssa_bin_unload(SSA_Bin *bin) {
+  munmap((void *)bin->header, bin->size);
+  bin->header = NULL;
+}
+
+static const char *sz_name_tbl[] = {"", "8", "16", "32", "64"};
+
+static void
+dump_nullable_reg(FILE *file, RegId reg, int sz) {
+  if (reg != 0) {
+    fprintf(file, "%%%ld =%s ", reg, sz_name_tbl[sz]);
+  }
+}
+
+static void
+inst_dump(FILE *file, const SSA_Bin *bin, const SSA_BinInst *inst) {
+  dump_nullable_reg(file, inst->result, inst->sz);
+  if (inst->t == INST_IMM) {
+    fprintf(file, "$%" PRIu64, inst->data.imm);
+  } else if (inst->t == INST_CALLFN) {
+    const SSA_BinFn *callee = ssa_bin_fn(bin, inst->data.callfn.fn);
+    fprintf(file, "callfn %.*s(", (int)callee->name_sz,
+            (const char *)ssa_bin_ptr(&callee->name));
+    const RegId *args = ssa_bin_ptr(&inst->data.callfn.args);
+    for (size_t i = 0; i < inst->nargs; i++) {
+      fprintf(file, i + 1 < inst->nargs ? "%%%zd, " : "%%%zd", args[i]);
+    }
+    fprintf(file, ")");
+  } else {
+    fprintf(file, "%s", inst_name_tbl[inst->t]);
+    for (int i = 0; i < inst_arity_tbl[inst->t]; i++) {
+      fprintf(file, " %%%" PRIu64, inst->data.operands[i]);
+    }
+  }
+  fprintf(file, "\n");
+}
+
+static void
+function_dump(FILE *file, const SSA_Bin *bin, const SSA_BinFn *fn,
+              int reg_dump) {
+  const RegId *params = ssa_bin_ptr(&fn->params);
+  const uint8_t *regs = ssa_bin_ptr(&fn->regs);
+
+  fprintf(file, "fn %.*s(", (int)fn->name_sz,
+          (const char *)ssa_bin_ptr(&fn->name));
+  for (size_t i = 0; i < fn->nparams; i++) {
+    fprintf(file, "%%%ld: %s%s", params[i], sz_name_tbl[regs[params[i] - 1]],
+            i + 1 < fn->nparams ? ", " : "");
+  }
+  fprintf(file, ")\n");
+
+  /* like ssa_prog_dump, only the entry block is printed */
+  const SSA_BinBlock *entry = ssa_bin_ptr(&fn->blocks);
+  const SSA_BinInst *insts = ssa_bin_ptr(&entry->insts);
+  for (size_t i = 0; i < entry->ninsts; i++) {
+    inst_dump(file, bin, &insts[i]);
+  }
+
+  if (reg_dump) {
+    fprintf(file, "\n");
+    for (size_t i = 0; i < fn->nregs; i++) {
+      fprintf(file, "| %zd | bit%s |\n", i + 1, sz_name_tbl[regs[i]]);
+    }
+  }
+  fprintf(file, "\n");
+}
+
+void
+ssa_bin_dump(FILE *file, const SSA_Bin *bin, int reg_dump) {
+  for (size_t i = 0; i < bin->header->nfns; i++) {
+    function_dump(file, bin, ssa_bin_fn(bin, i), reg_dump);
+  }
+}
@@ -0,0 +1,510 @@
+#include "ssa_opt.h"
+
+#include <string.h>
+
+#include "jobs.h"
+
+static const uint8_t sz_bits_tbl[] = {
+    [SZ_NONE] = 0, [SZ_8] = 8, [SZ_16] = 16, [SZ_32] = 32, [SZ_64] = 64,
+};
+
+static inline uint64_t
+sz_mask(SizeKind sz) {
+  uint8_t bits = sz_bits_tbl[sz];
+  return bits == 64 ? UINT64_MAX : ((uint64_t)1 << bits) - 1;
+}
+
+static inline int64_t
+sign_extend(uint64_t val, SizeKind sz) {
+  uint64_t sign = (uint64_t)1 << (sz_bits_tbl[sz] - 1);
+  return (int64_t)(((val & sz_mask(sz)) ^ sign) - sign);
+}
+
+/* returns 0 if the result can only be known at run time */
+static int
+fold_binop(InstKind t, SizeKind sz, uint64_t a, uint64_t b, uint64_t *result) {
+  if (sz == SZ_NONE) {
+    return 0;
+  }
+  uint64_t mask = sz_mask(sz);
+  a &= mask;
+  b &= mask;
+  switch (t) {
+    case INST_ADD:
+      *result = a + b;
+      break;
+    case INST_SUB:
+      *result = a - b;
+      break;
+    case INST_IMUL:
+    case INST_UMUL:
+      /* the low bits of a product don't depend on the signedness */
+      *result = a * b;
+      break;
+    case INST_UDIV:
+      if (b == 0) {
+        return 0;
+      }
+      *result = a / b;
+      break;
+    case INST_IDIV:
+      {
+        int64_t sa = sign_extend(a, sz);
+        int64_t sb = sign_extend(b, sz);
+        int64_t min = -(int64_t)(mask >> 1) - 1;
+        /* both trap, the second because the quotient doesn't fit */
+        if (sb == 0 || (sb == -1 && sa == min)) {
+          return 0;
+        }
+        *result = (uint64_t)(sa / sb);
+        break;
+      }
+    default:
+      return 0;
+  }
+  *result &= mask;
+  return 1;
+}
+
+/* operands of inst, including the arguments of calls */
+static inline RegId *
+inst_uses(SSA_Inst *inst, size_t *count) {
+  if (inst->t == INST_CALLFN) {
+    *count = inst->data.callfn.args.items;
+    return (RegId *)inst->data.callfn.args.data;
+  }
+  *count = inst_arity_tbl[inst->t];
+  return inst->data.operands;
+}
+
+static inline void
+make_imm(SSA_Inst *inst, uint64_t val) {
+  inst->t = INST_IMM;
+  inst->data.imm = val;
+}
+
+void
+ssa_fold_constants(SSA_Fn *fn, MemPool *scratch) {
+  MemPoolMark mark = mempool_mark(scratch);
+  /* indexed by RegId, registers are only assigned once so a constant stays
+   * constant for the rest of the function */
+  size_t nregs = fn->regs.items + 1;
+  uint8_t *known = mempool_alloc(scratch, nregs);
+  uint64_t *vals = mempool_alloc(scratch, sizeof(uint64_t) * nregs);
+  memset(known, 0, nregs);
+
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    SSA_Inst *insts = (SSA_Inst *)block->insts.data;
+    for (size_t i = 0; i < block->insts.items; i++) {
+      SSA_Inst *inst = &insts[i];
+      RegId *ops = inst->data.operands;
+      uint64_t val;
+      switch (inst->t) {
+        case INST_IMM:
+          val = inst->data.imm & sz_mask(inst->sz);
+          break;
+        case INST_COPY:
+          if (inst->result == 0 || !known[ops[0]]) {
+            continue;
+          }
+          val = vals[ops[0]];
+          make_imm(inst, val);
+          break;
+        case INST_ADD:
+        case INST_SUB:
+        case INST_IMUL:
+        case INST_UMUL:
+        case INST_IDIV:
+        case INST_UDIV:
+          if (!known[ops[0]] || !known[ops[1]] ||
+              !fold_binop(inst->t, inst->sz, vals[ops[0]], vals[ops[1]],
+                          &val)) {
+            continue;
+          }
+          make_imm(inst, val);
+          break;
+        default:
+          continue;
+      }
+      known[inst->result] = 1;
+      vals[inst->result] = val;
+    }
+  }
+
+  mempool_release(scratch, mark);
+}
+
+/* Registers are defined before they are used, so by the time a copy is
+ * reached its operand has already been rewritten to the original value and
+ * chains of copies collapse in one walk. */
+void
+ssa_propagate_copies(SSA_Fn *fn, MemPool *scratch) {
+  MemPoolMark mark = mempool_mark(scratch);
+  size_t nregs = fn->regs.items + 1;
+  RegId *repl = mempool_alloc(scratch, sizeof(RegId) * nregs);
+  for (RegId reg = 0; reg < nregs; reg++) {
+    repl[reg] = reg;
+  }
+
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    SSA_Inst *insts = (SSA_Inst *)block->insts.data;
+    size_t kept = 0;
+    for (size_t i = 0; i < block->insts.items; i++) {
+      SSA_Inst *inst = &insts[i];
+      size_t nuses;
+      RegId *uses = inst_uses(inst, &nuses);
+      for (size_t op = 0; op < nuses; op++) {
+        uses[op] = repl[uses[op]];
+      }
+
+      if (inst->t == INST_COPY && inst->result != 0) {
+        repl[inst->result] = uses[0];
+      } else {
+        insts[kept++] = *inst;
+      }
+    }
+    block->insts.items = kept;
+  }
+
+  mempool_release(scratch, mark);
+}
+
+/* An instruction in the value table, a and b are the value numbers of the
+ * operands or the constant of an INST_IMM */
+typedef struct {
+  uint64_t a;
+  uint64_t b;
+  uint64_t kind; /* InstKind and SizeKind, 0 for an empty slot */
+  int64_t vn;
+} ValueKey;
+
+static inline int
+is_commutative(InstKind t) {
+  return t == INST_ADD || t == INST_IMUL || t == INST_UMUL;
+}
+
+typedef struct {
+  ValueKey *slots;
+  size_t mask;
+  int64_t counter;  /* for next_vn */
+  int64_t *vns;     /* indexed by RegId, 0 if not numbered yet */
+  RegId *leaders;   /* indexed by value number, the register holding it */
+} ValueTable;
+
+static int64_t
+reg_vn(ValueTable *table, RegId reg) {
+  if (table->vns[reg] == 0) {
+    /* parameters and results that are never equal to anything else */
+    table->vns[reg] = next_vn(&table->counter);
+    table->leaders[table->vns[reg]] = reg;
+  }
+  return table->vns[reg];
+}
+
+/* returns the register already holding the value of inst, or 0 after
+ * numbering it */
+static RegId
+find_value(ValueTable *table, SSA_Inst *inst) {
+  ValueKey key;
+  key.kind = 1 + (inst->t | inst->sz << 8);
+  if (inst->t == INST_IMM) {
+    key.a = inst->data.imm & sz_mask(inst->sz);
+    key.b = 0;
+  } else {
+    key.a = reg_vn(table, inst->data.operands[0]);
+    key.b = reg_vn(table, inst->data.operands[1]);
+    if (is_commutative(inst->t) && key.a > key.b) {
+      uint64_t temp = key.a;
+      key.a = key.b;
+      key.b = temp;
+    }
+  }
+
+  size_t idx = hash_bytes((const uint8_t *)&key, 3 * sizeof(uint64_t), 0);
+  for (;; idx++) {
+    ValueKey *slot = &table->slots[idx & table->mask];
+    if (slot->kind == 0) {
+      key.vn = next_vn(&table->counter);
+      *slot = key;
+      table->vns[inst->result] = key.vn;
+      table->leaders[key.vn] = inst->result;
+      return 0;
+    }
+    if (slot->kind == key.kind && slot->a == key.a && slot->b == key.b) {
+      return table->leaders[slot->vn];
+    }
+  }
+}
+
+/* The blocks of a function form a chain without branches, so each block
+ * dominates the ones after it and one table for the whole function only
+ * ever finds values from dominating instructions.  Once blocks can branch,
+ * entries have to be scoped to the dominator tree. */
+void
+ssa_number_values(SSA_Fn *fn, MemPool *scratch) {
+  MemPoolMark mark = mempool_mark(scratch);
+  size_t nregs = fn->regs.items + 1;
+  size_t ninsts = 0;
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    ninsts += block->insts.items;
+  }
+  size_t nslots = 16;
+  while (nslots < 2 * ninsts) {
+    nslots *= 2;
+  }
+
+  ValueTable table;
+  table.slots = mempool_alloc(scratch, sizeof(ValueKey) * nslots);
+  memset(table.slots, 0, sizeof(ValueKey) * nslots);
+  table.mask = nslots - 1;
+  table.counter = 0;
+  /* every register gets at most one new value number */
+  table.vns = mempool_alloc(scratch, sizeof(int64_t) * nregs);
+  memset(table.vns, 0, sizeof(int64_t) * nregs);
+  table.leaders = mempool_alloc(scratch, sizeof(RegId) * (nregs + 1));
+  RegId *repl = mempool_alloc(scratch, sizeof(RegId) * nregs);
+  for (RegId reg = 0; reg < nregs; reg++) {
+    repl[reg] = reg;
+  }
+
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    SSA_Inst *insts = (SSA_Inst *)block->insts.data;
+    size_t kept = 0;
+    for (size_t i = 0; i < block->insts.items; i++) {
+      SSA_Inst *inst = &insts[i];
+      size_t nuses;
+      RegId *uses = inst_uses(inst, &nuses);
+      for (size_t op = 0; op < nuses; op++) {
+        uses[op] = repl[uses[op]];
+      }
+
+      RegId existing = 0;
+      if (inst->result != 0 && inst->t == INST_COPY) {
+        existing = table.leaders[reg_vn(&table, uses[0])];
+      } else if (inst->result != 0 && inst->t != INST_CALLFN) {
+        existing = find_value(&table, inst);
+      }
+      if (existing != 0) {
+        repl[inst->result] = existing;
+      } else {
+        insts[kept++] = *inst;
+      }
+    }
+    block->insts.items = kept;
+  }
+
+  mempool_release(scratch, mark);
+}
+
+/* defining instruction of every register, NULL for parameters */
+static SSA_Inst **
+find_defs(SSA_Fn *fn, MemPool *scratch) {
+  size_t nregs = fn->regs.items + 1;
+  SSA_Inst **defs = mempool_alloc(scratch, sizeof(SSA_Inst *) * nregs);
+  memset(defs, 0, sizeof(SSA_Inst *) * nregs);
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    SSA_Inst *insts = (SSA_Inst *)block->insts.data;
+    for (size_t i = 0; i < block->insts.items; i++) {
+      if (insts[i].result != 0) {
+        defs[insts[i].result] = &insts[i];
+      }
+    }
+  }
+  return defs;
+}
+
+static int
+div_can_trap(SSA_Inst *inst, SSA_Inst **defs) {
+  if (inst->t != INST_IDIV && inst->t != INST_UDIV) {
+    return 0;
+  }
+  SSA_Inst *divisor = defs[inst->data.operands[1]];
+  if (divisor == NULL || divisor->t != INST_IMM) {
+    return 1;
+  }
+  uint64_t mask = sz_mask(inst->sz);
+  uint64_t val = divisor->data.imm & mask;
+  /* -1 only traps on the smallest dividend, which isn't worth checking */
+  return val == 0 || (inst->t == INST_IDIV && val == mask);
+}
+
+/* whether inst has to stay even if its result is unused */
+static int
+inst_has_effect(SSA_Inst *inst, SSA_Inst **defs) {
+  if (!inst_returns_tbl[inst->t]) {
+    return 1;
+  }
+  if (inst->t == INST_CALLFN) {
+    return !inst->data.callfn.fn->pure;
+  }
+  return div_can_trap(inst, defs);
+}
+
+/* Works from the leaves of the call graph up: a function becomes pure once
+ * all of the calls it makes are to pure functions, so every function and
+ * call is only visited a constant number of times. */
+void
+ssa_find_pure_fns(SSA_Prog *prog, MemPool *scratch) {
+  MemPoolMark mark = mempool_mark(scratch);
+  size_t nfns = prog->fns.items;
+  SSA_Fn *fns = (SSA_Fn *)prog->fns.data;
+  /* calls to functions not known to be pure yet, or SIZE_MAX if the function
+   * can never be pure */
+  size_t *pending = mempool_alloc(scratch, sizeof(size_t) * nfns);
+  /* callers[callers_start[g]..callers_start[g + 1]] are the functions that
+   * call g, once per call */
+  size_t *callers_start = mempool_alloc(scratch, sizeof(size_t) * (nfns + 1));
+  memset(callers_start, 0, sizeof(size_t) * (nfns + 1));
+
+  for (size_t f = 0; f < nfns; f++) {
+    fns[f].pure = 0;
+    pending[f] = 0;
+    MemPoolMark defs_mark = mempool_mark(scratch);
+    SSA_Inst **defs = find_defs(&fns[f], scratch);
+    for (SSA_BBlock *block = fns[f].entry; block != NULL;
+         block = block->next) {
+      SSA_Inst *insts = (SSA_Inst *)block->insts.data;
+      for (size_t i = 0; i < block->insts.items; i++) {
+        if (insts[i].t == INST_CALLFN) {
+          callers_start[insts[i].data.callfn.fn - fns + 1]++;
+          if (pending[f] != SIZE_MAX) {
+            pending[f]++;
+          }
+        } else if (div_can_trap(&insts[i], defs)) {
+          pending[f] = SIZE_MAX;
+        }
+      }
+    }
+    mempool_release(scratch, defs_mark);
+  }
+
+  for (size_t f = 0; f < nfns; f++) {
+    callers_start[f + 1] += callers_start[f];
+  }
+  size_t *callers =
+      mempool_alloc(scratch, sizeof(size_t) * callers_start[nfns]);
+  size_t *fill = mempool_alloc(scratch, sizeof(size_t) * nfns);
+  memcpy(fill, callers_start, sizeof(size_t) * nfns);
+  for (size_t f = 0; f < nfns; f++) {
+    for (SSA_BBlock *block = fns[f].entry; block != NULL;
+         block = block->next) {
+      SSA_Inst *insts = (SSA_Inst *)block->insts.data;
+      for (size_t i = 0; i < block->insts.items; i++) {
+        if (insts[i].t == INST_CALLFN) {
+          callers[fill[insts[i].data.callfn.fn - fns]++] = f;
+        }
+      }
+    }
+  }
+
+  /* fill is reused as the stack of functions found pure */
+  size_t *stack = fill;
+  size_t top = 0;
+  for (size_t f = 0; f < nfns; f++) {
+    if (pending[f] == 0) {
+      fns[f].pure = 1;
+      stack[top++] = f;
+    }
+  }
+  while (top > 0) {
+    size_t g = stack[--top];
+    for (size_t i = callers_start[g]; i < callers_start[g + 1]; i++) {
+      size_t f = callers[i];
+      if (pending[f] != SIZE_MAX && --pending[f] == 0) {
+        fns[f].pure = 1;
+        stack[top++] = f;
+      }
+    }
+  }
+
+  mempool_release(scratch, mark);
+}
+
+/* Marks instructions as dead walking backwards, so every use of a result has
+ * been seen by the time its definition is reached and the operands of a
+ * dead instruction can lose their use right away.  Live instructions are
+ * then moved down over the dead ones in a single forward walk. */
+void
+ssa_eliminate_dead_code(SSA_Fn *fn, MemPool *scratch) {
+  MemPoolMark mark = mempool_mark(scratch);
+  size_t nregs = fn->regs.items + 1;
+  SSA_Inst **defs = find_defs(fn, scratch);
+  uint32_t *uses = mempool_alloc(scratch, sizeof(uint32_t) * nregs);
+  memset(uses, 0, sizeof(uint32_t) * nregs);
+
+  size_t nblocks = 0;
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    SSA_Inst *insts = (SSA_Inst *)block->insts.data;
+    for (size_t i = 0; i < block->insts.items; i++) {
+      size_t nuses;
+      RegId *regs = inst_uses(&insts[i], &nuses);
+      for (size_t op = 0; op < nuses; op++) {
+        uses[regs[op]]++;
+      }
+    }
+    nblocks++;
+  }
+  SSA_BBlock **blocks = mempool_alloc(scratch, sizeof(SSA_BBlock *) * nblocks);
+  uint8_t **dead = mempool_alloc(scratch, sizeof(uint8_t *) * nblocks);
+  nblocks = 0;
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    dead[nblocks] = mempool_alloc(scratch, block->insts.items);
+    blocks[nblocks++] = block;
+  }
+
+  for (size_t b = nblocks; b > 0; b--) {
+    SSA_Inst *insts = (SSA_Inst *)blocks[b - 1]->insts.data;
+    for (size_t i = blocks[b - 1]->insts.items; i > 0; i--) {
+      SSA_Inst *inst = &insts[i - 1];
+      int unused = inst->result == 0 || uses[inst->result] == 0;
+      dead[b - 1][i - 1] = unused && !inst_has_effect(inst, defs);
+      if (dead[b - 1][i - 1]) {
+        size_t nuses;
+        RegId *regs = inst_uses(inst, &nuses);
+        for (size_t op = 0; op < nuses; op++) {
+          uses[regs[op]]--;
+        }
+      }
+    }
+  }
+
+  for (size_t b = 0; b < nblocks; b++) {
+    SSA_Inst *insts = (SSA_Inst *)blocks[b]->insts.data;
+    size_t kept = 0;
+    for (size_t i = 0; i < blocks[b]->insts.items; i++) {
+      if (!dead[b][i]) {
+        insts[kept++] = insts[i];
+      }
+    }
+    blocks[b]->insts.items = kept;
+  }
+
+  mempool_release(scratch, mark);
+}
+
+/* passes that only look at the function itself */
+static void
+simplify_fn_job(void *ctx, size_t idx, size_t worker) {
+  SSA_Prog *prog = ctx;
+  SSA_Fn *fn = vector_idx(&prog->fns, idx);
+  MemPool *scratch = &prog->worker_pools[worker];
+  ssa_propagate_copies(fn, scratch);
+  ssa_fold_constants(fn, scratch);
+  ssa_number_values(fn, scratch);
+}
+
+static void
+dead_code_job(void *ctx, size_t idx, size_t worker) {
+  SSA_Prog *prog = ctx;
+  ssa_eliminate_dead_code(vector_idx(&prog->fns, idx),
+                          &prog->worker_pools[worker]);
+}
+
+/* Which functions are pure depends on the other functions, so it is found
+ * between the passes that run in parallel */
+void
+ssa_optimize(SSA_Prog *prog) {
+  parallel_for(prog->jobs, prog->fns.items, simplify_fn_job, prog);
+  ssa_find_pure_fns(prog, &prog->worker_pools[0]);
+  parallel_for(prog->jobs, prog->fns.items, dead_code_job, prog);
+}
@@ -0,0 +1,118 @@
+#include "stream.h"
+
+#include "ir_gen.h"
+#include "lexer.h"
+#include "parser.h"
+#include "semantics.h"
+
+static inline uint32_t
+tok_end(const SourceFile *file, Token tok) {
+  return tok.pos.start + tok.pos.sz - file->src;
+}
+
+/* Splits file into functions without keeping its tokens.  Whatever is not a
+ * function is left for the parser to report. */
+static void
+find_fns(Stream *stream, SourceFile *file, uint32_t file_idx) {
+  if (file->sz > UINT32_MAX) {
+    log_err_final("source files larger than 4 GiB are not supported");
+  }
+
+  Lexer lex;
+  lexer_init(&lex, file->src, file->sz, stream->interner);
+  Token tok;
+  while ((tok = lexer_next(&lex)).t != TOK_EOF) {
+    StreamFn *fn = vector_alloc(&stream->fns);
+    fn->file = file_idx;
+    fn->start = tok.pos.start - file->src;
+    while (tok.t != TOK_LCURLY && tok.t != TOK_EOF) {
+      tok = lexer_next(&lex);
+    }
+    fn->body = tok_end(file, tok);
+
+    size_t depth = tok.t == TOK_LCURLY;
+    while (depth > 0 && tok.t != TOK_EOF) {
+      tok = lexer_next(&lex);
+      if (tok.t == TOK_LCURLY) {
+        depth++;
+      } else if (tok.t == TOK_RCURLY) {
+        depth--;
+      }
+    }
+    fn->end = tok_end(file, tok);
+    if (tok.t == TOK_EOF) {
+      break;
+    }
+  }
+}
+
+/* Lexes [start, end) of file.  Positions of the tokens are still pointers
+ * into the whole source. */
+static void
+lex_range(Stream *stream, SourceFile *file, uint32_t start, uint32_t end,
+          TokenBuffer *toks, MemPool *pool) {
+  Lexer lex;
+  lexer_init(&lex, file->src + start, end - start, stream->interner);
+  lexer_tokenize(&lex, toks, pool);
+}
+
+void
+stream_declare_fns(Stream *stream, AST *ast, SSA_Prog *prog,
+                   Interner *interner) {
+  stream->ast = ast;
+  stream->prog = prog;
+  stream->interner = interner;
+  vector_init(&stream->fns, sizeof(StreamFn), ast->pool);
+  for (size_t i = 0; i < ast->files.items; i++) {
+    find_fns(stream, vector_idx(&ast->files, i), i);
+  }
+  vector_freeze(&stream->fns);
+
+  MemPool *scratch = &ast->scratch_pools[0];
+  vector_reserve(&ast->fns, stream->fns.items);
+  for (size_t i = 0; i < stream->fns.items; i++) {
+    StreamFn *range = vector_idx(&stream->fns, i);
+    SourceFile *file = vector_idx(&ast->files, range->file);
+    MemPoolMark mark = mempool_mark(scratch);
+
+    TokenBuffer toks;
+    lex_range(stream, file, range->start, range->body, &toks, scratch);
+    Parser parser;
+    parser_init_tokens(&parser, file, &toks, ast->pool, scratch);
+    Function *fn = vector_alloc(&ast->fns);
+    parse_fn_sig(&parser, fn);
+    fn->toks = NULL; /* released below */
+
+    mempool_release(scratch, mark);
+  }
+
+  declare_fns(ast);
+  ssa_prog_declare_fns(prog, ast);
+}
+
+void
+stream_compile_fns(Stream *stream) {
+  AST *ast = stream->ast;
+  MemPool *pool = &ast->worker_pools[0];
+  MemPool *scratch = &ast->scratch_pools[0];
+  for (size_t i = 0; i < stream->fns.items; i++) {
+    StreamFn *range = vector_idx(&stream->fns, i);
+    SourceFile *file = vector_idx(&ast->files, range->file);
+    Function *decl = vector_idx(&ast->fns, i);
+    MemPoolMark mark = mempool_mark(pool);
+
+    TokenBuffer toks;
+    lex_range(stream, file, range->start, range->end, &toks, pool);
+    Parser parser;
+    parser_init_tokens(&parser, file, &toks, pool, scratch);
+    Function fn;
+    parse_fn(&parser, &fn);
+    fn.entry = decl->entry;
+
+    check_fn(ast, &fn, pool);
+    translate_function(&fn, vector_idx(&stream->prog->fns, i),
+                       &stream->prog->worker_pools[0], scratch);
+
+    mempool_release(pool, mark);
+  }
+}
@@ -2,9 +2,11 @@
 
 #include <string.h>
 
-#define INIT_BUCKETS 32
+/* must be a power of two */
+#define INIT_SLOTS 16
 
-#define MIN(a, b) (a > b ? b : a)
+/* grow once more than 3/4 of the slots are taken */
+#define NEEDS_GROW(scope) ((scope)->count * 4 >= (scope)->nslots * 3)
 
 VarInfo
 make_var_info(int mut, struct Type *type) {
@@ -12,54 +14,111 @@ make_var_info(int mut, struct Type *type) {
   return inf;
 }
 
+static ScopeSlot *
+alloc_slots(MemPool *pool, size_t nslots) {
+  ScopeSlot *slots = mempool_alloc(pool, sizeof(ScopeSlot) * nslots);
+  memset(slots, 0, sizeof(ScopeSlot) * nslots);
+  return slots;
+}
+
 Scope *
 scope_init(MemPool *pool, Scope *up) {
   Scope *scope = mempool_alloc(pool, sizeof(Scope));
-  scope->nbuckets = INIT_BUCKETS;
   scope->up = up;
-  scope->buckets = mempool_alloc(pool, sizeof(ScopeEntry *) * scope->nbuckets);
-  memset(scope->buckets, 0, sizeof(ScopeEntry *) * scope->nbuckets);
+  scope->count = 0;
+  scope->nslots = INIT_SLOTS;
+  scope->slots = alloc_slots(pool, scope->nslots);
   return scope;
 }
 
 static inline size_t
-hash_str(SourcePosition pos) {
-  size_t total = 0;
-  for (size_t i = 0; i < pos.sz; i++) {
-    total += pos.start[i];
+probe_dist(Scope *scope, Atom atom, size_t idx) {
+  return (idx - atom_hash(atom)) & (scope->nslots - 1);
+}
+
+/* Robin Hood insertion: an entry that is closer to its ideal slot than the
+ * one being inserted gives up its slot, which keeps probe sequences short and
+ * lets lookups stop early */
+static void
+place_slot(Scope *scope, ScopeSlot slot) {
+  size_t mask = scope->nslots - 1;
+  size_t dist = 0;
+  for (size_t idx = atom_hash(slot.atom) & mask;;
+       idx = (idx + 1) & mask, dist++) {
+    ScopeSlot *cur = &scope->slots[idx];
+    if (cur->atom == 0) {
+      *cur = slot;
+      return;
+    }
+    size_t cur_dist = probe_dist(scope, cur->atom, idx);
+    if (cur_dist < dist) {
+      ScopeSlot temp = *cur;
+      *cur = slot;
+      slot = temp;
+      dist = cur_dist;
+    }
   }
-  return total;
 }
 
-ScopeEntry *
-scope_insert(MemPool *pool, Scope *scope, SourcePosition pos, VarInfo inf) {
-  size_t idx = hash_str(pos) % scope->nbuckets;
-  for (ScopeEntry *iter = scope->buckets[idx]; iter != NULL;
-       iter = iter->next) {
-    if (memcmp(pos.start, iter->pos.start, MIN(pos.sz, iter->pos.sz)) == 0) {
+static void
+scope_grow(MemPool *pool, Scope *scope) {
+  ScopeSlot *old_slots = scope->slots;
+  size_t old_nslots = scope->nslots;
+
+  scope->nslots *= 2;
+  scope->slots = alloc_slots(pool, scope->nslots);
+  for (size_t i = 0; i < old_nslots; i++) {
+    if (old_slots[i].atom != 0) {
+      place_slot(scope, old_slots[i]);
+    }
+  }
+}
+
+static ScopeEntry *
+scope_find_local(Scope *scope, Atom atom, uint32_t hash) {
+  size_t mask = scope->nslots - 1;
+  size_t dist = 0;
+  for (size_t idx = hash & mask;; idx = (idx + 1) & mask, dist++) {
+    ScopeSlot *cur = &scope->slots[idx];
+    if (cur->atom == atom) {
+      return cur->entry;
+    }
+    if (cur->atom == 0 || probe_dist(scope, cur->atom, idx) < dist) {
       return NULL;
     }
   }
+}
+
+ScopeEntry *
+scope_insert(MemPool *pool, Scope *scope, Atom atom, SourcePosition pos,
+             VarInfo inf) {
+  if (scope_find_local(scope, atom, atom_hash(atom)) != NULL) {
+    return NULL;
+  }
+
+  if (NEEDS_GROW(scope)) {
+    scope_grow(pool, scope);
+  }
 
   ScopeEntry *new_entry = mempool_alloc(pool, sizeof(ScopeEntry));
-  new_entry->next = scope->buckets[idx];
   new_entry->pos = pos;
+  new_entry->atom = atom;
   new_entry->inf = inf;
-  scope->buckets[idx] = new_entry;
+
+  ScopeSlot slot = {.atom = atom, .entry = new_entry};
+  place_slot(scope, slot);
+  scope->count++;
   return new_entry;
 }
 
 ScopeEntry *
-scope_find(Scope *scope, SourcePosition pos) {
-  size_t idx = hash_str(pos) % scope->nbuckets;
-  while (scope != NULL) {
-    for (ScopeEntry *iter = scope->buckets[idx]; iter != NULL;
-         iter = iter->next) {
-      if (memcmp(pos.start, iter->pos.start, MIN(pos.sz, iter->pos.sz)) == 0) {
-        return iter;
-      }
+scope_find(Scope *scope, Atom atom) {
+  uint32_t hash = atom_hash(atom);
+  for (; scope != NULL; scope = scope->up) {
+    ScopeEntry *entry = scope_find_local(scope, atom, hash);
+    if (entry != NULL) {
+      return entry;
     }
-    scope = scope->up;
   }
   return NULL;
 }
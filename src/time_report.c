@@ -0,0 +1,146 @@
+#define _GNU_SOURCE
+#include "time_report.h"
+
+#include <stdlib.h>
+
+#include "jobs.h"
+
+void
+time_report_init(TimeReport *report, Interner *interner, AST *ast,
+                 SSA_Prog *prog) {
+  report->interner = interner;
+  report->ast = ast;
+  report->prog = prog;
+  report->nphases = 0;
+  report->fn_times = NULL;
+  report->nfns = 0;
+  report->wall_start = wall_time_ns();
+  report->cpu_start = cpu_time_ns();
+}
+
+void
+time_report_deinit(TimeReport *report) {
+  if (report->fn_times != NULL) {
+    job_times_set(NULL);
+    free(report->fn_times);
+  }
+}
+
+void
+time_report_track_fns(TimeReport *report) {
+  report->nfns = report->ast->fns.items;
+  report->fn_times =
+      calloc(TIME_REPORT_MAX_PHASES * report->nfns, sizeof(uint64_t));
+  job_times_set(report->fn_times + report->nphases * report->nfns);
+}
+
+static void
+add_pools(PhaseTime *phase, MemPool *pools, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    MemPoolStats stats = mempool_stats(&pools[i]);
+    phase->committed += stats.committed;
+    phase->used += stats.used;
+  }
+}
+
+void
+time_report_phase(TimeReport *report, const char *name) {
+  if (report->nphases == TIME_REPORT_MAX_PHASES) {
+    log_internal_err("more than %d phases in the time report",
+                     TIME_REPORT_MAX_PHASES);
+  }
+  uint64_t wall = wall_time_ns();
+  uint64_t cpu = cpu_time_ns();
+
+  PhaseTime *phase = &report->phases[report->nphases++];
+  phase->name = name;
+  phase->wall_ns = wall - report->wall_start;
+  phase->cpu_ns = cpu - report->cpu_start;
+  phase->committed = 0;
+  phase->used = 0;
+  /* the pools of the AST and of the program are contiguous arrays */
+  add_pools(phase, report->interner->pool, 1);
+  add_pools(phase, report->ast->pool, AST_POOL_COUNT(report->ast->nworkers));
+  add_pools(phase, report->prog->pool, 1 + report->prog->nworkers);
+
+  if (report->fn_times != NULL && report->nphases < TIME_REPORT_MAX_PHASES) {
+    job_times_set(report->fn_times + report->nphases * report->nfns);
+  }
+  /* the report itself is not part of the next phase */
+  report->wall_start = wall_time_ns();
+  report->cpu_start = cpu_time_ns();
+}
+
+typedef struct {
+  uint64_t total;
+  size_t fn;
+} FnTotal;
+
+static int
+cmp_fn_total(const void *a, const void *b) {
+  const FnTotal *fa = a, *fb = b;
+  return (fa->total < fb->total) - (fa->total > fb->total);
+}
+
+static void
+print_slowest(FILE *file, TimeReport *report, size_t top) {
+  FnTotal *totals = malloc(sizeof(FnTotal) * report->nfns);
+  int timed[TIME_REPORT_MAX_PHASES] = {0};
+  for (size_t i = 0; i < report->nfns; i++) {
+    totals[i].total = 0;
+    totals[i].fn = i;
+    for (size_t p = 0; p < report->nphases; p++) {
+      uint64_t t = report->fn_times[p * report->nfns + i];
+      totals[i].total += t;
+      timed[p] |= t != 0;
+    }
+  }
+  qsort(totals, report->nfns, sizeof(FnTotal), cmp_fn_total);
+  if (top > report->nfns) {
+    top = report->nfns;
+  }
+
+  fprintf(file, "\n%-24s %10s", "slowest functions", "ms");
+  for (size_t p = 0; p < report->nphases; p++) {
+    if (timed[p]) {
+      fprintf(file, " %14s", report->phases[p].name);
+    }
+  }
+  fprintf(file, "\n");
+  for (size_t i = 0; i < top; i++) {
+    Function *fn = vector_idx(&report->ast->fns, totals[i].fn);
+    int name_sz = fn->name.sz > 24 ? 24 : fn->name.sz;
+    fprintf(file, "%-24.*s %10.3f", name_sz, (const char *)fn->name.start,
+            totals[i].total / 1e6);
+    for (size_t p = 0; p < report->nphases; p++) {
+      if (timed[p]) {
+        fprintf(file, " %14.3f",
+                report->fn_times[p * report->nfns + totals[i].fn] / 1e6);
+      }
+    }
+    fprintf(file, "\n");
+  }
+  free(totals);
+}
+
+void
+time_report_print(FILE *file, TimeReport *report, size_t top) {
+  flockfile(file);
+  fprintf(file, "%-24s %10s %10s %14s %14s\n", "phase", "wall ms", "cpu ms",
+          "committed KiB", "used KiB");
+  uint64_t wall = 0, cpu = 0;
+  for (size_t i = 0; i < report->nphases; i++) {
+    PhaseTime *phase = &report->phases[i];
+    fprintf(file, "%-24s %10.3f %10.3f %14zu %14zu\n", phase->name,
+            phase->wall_ns / 1e6, phase->cpu_ns / 1e6,
+            phase->committed / 1024, phase->used / 1024);
+    wall += phase->wall_ns;
+    cpu += phase->cpu_ns;
+  }
+  fprintf(file, "%-24s %10.3f %10.3f\n", "total", wall / 1e6, cpu / 1e6);
+
+  if (report->fn_times != NULL && top > 0) {
+    print_slowest(file, report, top);
+  }
+  funlockfile(file);
+}